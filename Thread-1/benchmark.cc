@@ -1,23 +1,230 @@
 /*
- * This file provides an example of how to do automatic benchmark.  Feel free
- * to modify and use this tool.
+ * Benchmarks of the hot paths: the model math, the holders, the instruction
+ * parser and the end-to-end throughput of the executor. Most of them take
+ * the embedding dimension as their last argument, e.g.
+ *
+ *   bazel run -c opt //:benchmark -- --benchmark_filter=Recommend
+ *
+ * `a_slow_function` is a no-op in this build, so `calc_gradient` and the
+ * throughput numbers measure our own code only.
  */
 
 #include <benchmark/benchmark.h>
 
-static void BM_StringCreation(benchmark::State& state) {
-  for (auto _ : state)
-    std::string empty_string;
+#include <cstdio>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unistd.h>
+
+#include "lib/model.h"
+#include "lib/runner.h"
+#include "lib/executor.h"
+#include "lib/embedding.h"
+#include "lib/instruction.h"
+
+namespace {
+
+using namespace proj1;
+
+const std::vector<int64_t> kDims = {16, 64, 256};
+
+Embedding* random_embedding(int dim, std::mt19937* rng) {
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    double* data = new double[dim];
+    for (int i = 0; i < dim; ++i) {
+        data[i] = uniform(*rng);
+    }
+    return new Embedding(dim, data);
 }
-// Register the function as a benchmark
-BENCHMARK(BM_StringCreation);
 
-// Define another benchmark
-static void BM_StringCopy(benchmark::State& state) {
-  std::string x = "hello";
-  for (auto _ : state)
-    std::string copy(x);
+EmbeddingHolder* random_holder(int n_rows, int dim, std::mt19937* rng) {
+    EmbeddingMatrix matrix;
+    for (int i = 0; i < n_rows; ++i) {
+        matrix.push_back(random_embedding(dim, rng));
+    }
+    return new EmbeddingHolder(matrix);
 }
-BENCHMARK(BM_StringCopy);
 
-BENCHMARK_MAIN();
\ No newline at end of file
+// A file in the temp dir, removed when it goes out of scope
+struct TempFile {
+    TempFile(): path("/tmp/proj1_bench_" + std::to_string(getpid()) + "_" +
+                     std::to_string(counter++)) {}
+    ~TempFile() { std::remove(this->path.c_str()); }
+    std::string path;
+    static int counter;
+};
+int TempFile::counter = 0;
+
+// Updates and recommends over random rows, in the `*_instruction.tsv` format.
+// Recommends carry epoch -1, so the executor never has to hold them back.
+std::vector<std::string> random_instructions(int n, int n_users, int n_items,
+                                             int pool_size, std::mt19937* rng) {
+    std::uniform_int_distribution<int> user(0, n_users - 1), item(0, n_items - 1);
+    std::vector<std::string> lines;
+    for (int i = 0; i < n; ++i) {
+        std::string line;
+        if (i % 5 == 4) {
+            line = "2 " + std::to_string(user(*rng)) + " -1";
+            for (int j = 0; j < pool_size; ++j) {
+                line += " " + std::to_string(item(*rng));
+            }
+        } else {
+            line = "1 " + std::to_string(user(*rng)) + " " +
+                std::to_string(item(*rng)) + " " + std::to_string(i % 2);
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+void BM_Similarity(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int dim = state.range(0);
+    Embedding* a = random_embedding(dim, &rng);
+    Embedding* b = random_embedding(dim, &rng);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(similarity(a, b));
+    }
+    state.SetItemsProcessed(state.iterations());
+    delete a;
+    delete b;
+}
+BENCHMARK(BM_Similarity)->ArgsProduct({kDims});
+
+void BM_Update(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int dim = state.range(0);
+    Embedding* row = random_embedding(dim, &rng);
+    Embedding* gradient = random_embedding(dim, &rng);
+    for (auto _ : state) {
+        row->update(gradient, 1e-9);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+    delete row;
+    delete gradient;
+}
+BENCHMARK(BM_Update)->ArgsProduct({kDims});
+
+void BM_CalcGradient(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int dim = state.range(0);
+    Embedding* a = random_embedding(dim, &rng);
+    Embedding* b = random_embedding(dim, &rng);
+    for (auto _ : state) {
+        EmbeddingGradient* gradient = calc_gradient(a, b, 1);
+        benchmark::DoNotOptimize(gradient);
+        delete gradient;
+    }
+    state.SetItemsProcessed(state.iterations());
+    delete a;
+    delete b;
+}
+BENCHMARK(BM_CalcGradient)->ArgsProduct({kDims});
+
+// Arguments: pool size, dimension
+void BM_Recommend(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int pool_size = state.range(0);
+    int dim = state.range(1);
+    Embedding* user = random_embedding(dim, &rng);
+    std::vector<Embedding*> pool;
+    for (int i = 0; i < pool_size; ++i) {
+        pool.push_back(random_embedding(dim, &rng));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(recommend(user, pool));
+    }
+    state.SetItemsProcessed(state.iterations() * pool_size);
+    delete user;
+    for (Embedding* item: pool) delete item;
+}
+BENCHMARK(BM_Recommend)->ArgsProduct({{10, 100, 1000, 10000, 100000}, kDims});
+
+// Arguments: number of rows, dimension
+void BM_HolderRead(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int n_rows = state.range(0);
+    TempFile file;
+    EmbeddingHolder* holder = random_holder(n_rows, state.range(1), &rng);
+    holder->write(file.path);
+    delete holder;
+    for (auto _ : state) {
+        EmbeddingHolder read(file.path);
+        benchmark::DoNotOptimize(read.get_n_embeddings());
+    }
+    state.SetItemsProcessed(state.iterations() * n_rows);
+}
+BENCHMARK(BM_HolderRead)->ArgsProduct({{1000}, kDims})->Unit(benchmark::kMillisecond);
+
+void BM_HolderWrite(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int n_rows = state.range(0);
+    TempFile file;
+    EmbeddingHolder* holder = random_holder(n_rows, state.range(1), &rng);
+    for (auto _ : state) {
+        holder->write(file.path);
+    }
+    state.SetItemsProcessed(state.iterations() * n_rows);
+    delete holder;
+}
+BENCHMARK(BM_HolderWrite)->ArgsProduct({{1000}, kDims})->Unit(benchmark::kMillisecond);
+
+// Argument: number of instructions
+void BM_ReadInstructions(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int n = state.range(0);
+    TempFile file;
+    {
+        std::ofstream ofs(file.path);
+        for (const std::string& line: random_instructions(n, 1000, 1000, 16, &rng)) {
+            ofs << line << '\n';
+        }
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(read_instructrions(file.path));
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ReadInstructions)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// Arguments: executor workers, dimension. The same 10000 instructions are
+// run in every iteration, on rows that keep training.
+void BM_Throughput(benchmark::State& state) {
+    std::mt19937 rng(1);
+    int n_workers = state.range(0);
+    int dim = state.range(1);
+    EmbeddingHolder* users = random_holder(1000, dim, &rng);
+    EmbeddingHolder* items = random_holder(1000, dim, &rng);
+    Instructions insts;
+    for (const std::string& line: random_instructions(10000, 1000, 1000, 64, &rng)) {
+        insts.push_back(Instruction(line));
+    }
+    ExecutorOptions options;
+    options.n_workers = n_workers;
+    options.n_reserved_workers = std::min(options.n_reserved_workers, n_workers / 2);
+    options.first_new_row = users->get_n_embeddings();
+    // Recommend results are dropped, we only measure getting there
+    Executor executor([users, items] (const Instruction& inst) {
+        if (inst.order == RECOMMEND) {
+            benchmark::DoNotOptimize(reply_instruction(inst, users, items));
+        } else {
+            run_instruction(inst, users, items);
+        }
+    }, options);
+    for (auto _ : state) {
+        executor.run(insts);
+    }
+    state.SetItemsProcessed(state.iterations() * insts.size());
+    delete users;
+    delete items;
+}
+BENCHMARK(BM_Throughput)->ArgsProduct({{1, 2, 4, 8, 16}, kDims})
+    ->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,45 @@
+#include <string>   // string
+#include <cstdlib>  // atoi
+#include <iostream> // cout, cerr
+
+#include "lib/workload.h"
+
+// Synthetic inputs at any scale, written to stdout:
+//
+//   gen embeddings <rows> <dim> [seed] > data/big.in
+//   gen instructions [key=value ...] > data/big_instruction.tsv
+//
+// The keys of `instructions` are instructions, users, items, init, update,
+// recommend, user_skew, item_skew, epochs, min_pool, max_pool, init_items,
+// loaded_users and seed (see `WorkloadOptions`). Give `users` and `items` the
+// number of rows of the tables the stream will run against, and
+// `loaded_users=1` for a stream sent to the server.
+int main(int argc, char *argv[]) {
+    std::ios::sync_with_stdio(false);
+    std::string mode(argc > 1? argv[1]: "");
+    try {
+        if (mode == "embeddings" && argc >= 4) {
+            unsigned long seed = argc > 4? std::strtoul(argv[4], nullptr, 10): 1;
+            proj1::generate_embeddings(std::cout, atoi(argv[2]), atoi(argv[3]), seed);
+            return 0;
+        }
+        if (mode == "instructions") {
+            proj1::WorkloadOptions options;
+            for (int i = 2; i < argc; ++i) {
+                std::string arg(argv[i]);
+                size_t eq = arg.find('=');
+                if (eq == std::string::npos)
+                    throw std::runtime_error("Expected key=value, got " + arg + "!");
+                proj1::set_workload_option(&options, arg.substr(0, eq), arg.substr(eq + 1));
+            }
+            proj1::generate_instructions(std::cout, options);
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cerr << "usage: " << argv[0] << " embeddings <rows> <dim> [seed]\n"
+              << "       " << argv[0] << " instructions [key=value ...]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,188 @@
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "affinity.h"
+
+namespace proj1 {
+
+int primary_row(const Instruction& inst, int new_row) {
+    return inst.order == INIT_EMB? new_row: inst.payloads[0];
+}
+
+AffinityExecutor::AffinityExecutor(Handler handler, AffinityOptions options) :
+        handler(std::move(handler)),
+        options(options),
+        gate(options.first_new_row),
+        n_unfinished(0),
+        stopping(false) {
+    memset(&this->stats, 0, sizeof(this->stats));
+    int n_workers = std::max(1, options.n_workers);
+    for (int i = 0; i < n_workers; ++i) {
+        this->workers.emplace_back(new Worker());
+    }
+    for (int i = 0; i < n_workers; ++i) {
+        this->threads.emplace_back(&AffinityExecutor::worker_loop, this, i);
+    }
+}
+
+AffinityExecutor::~AffinityExecutor() {
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->stopping = true;
+        for (auto& worker: this->workers) {
+            worker->cv.notify_all();
+        }
+    }
+    for (std::thread& t: this->threads) {
+        t.join();
+    }
+}
+
+void AffinityExecutor::submit_locked(const Instruction& inst) {
+    int row = primary_row(inst, this->gate.submit(inst));
+    int home = (unsigned int) row % this->workers.size();
+    int key = 2 * inst.epoch() + (inst.order == RECOMMEND);
+    Task task(inst, row);
+    if (inst.order == INIT_EMB && this->gate.tracks_rows())
+        task.inst.append_row = row;
+    this->workers[home]->queue[key].push_back(std::move(task));
+    ++this->n_unfinished;
+
+    // Wake the home worker, or an idle one that may steal it if home is busy
+    if (this->workers[home]->idle) {
+        this->workers[home]->cv.notify_one();
+        return;
+    }
+    for (auto& worker: this->workers) {
+        if (worker->idle) {
+            worker->cv.notify_one();
+            return;
+        }
+    }
+}
+
+void AffinityExecutor::submit(const Instruction& inst) {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    this->submit_locked(inst);
+}
+
+void AffinityExecutor::run(const Instructions& insts) {
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        for (const Instruction& inst: insts) {
+            this->submit_locked(inst);
+        }
+        for (auto& worker: this->workers) {
+            worker->cv.notify_all();
+        }
+    }
+    this->wait();
+}
+
+void AffinityExecutor::wait() {
+    std::unique_lock<std::mutex> lk(this->mutex);
+    this->idle_cv.wait(lk, [this] { return this->n_unfinished == 0; });
+}
+
+AffinityExecutor::Queue::iterator AffinityExecutor::startable(Queue& queue) {
+    // Inits come first, but while one waits for the inits of other queues to
+    // start the instructions of the first epoch may go
+    auto it = queue.begin();
+    for (int i = 0; i < 2 && it != queue.end(); ++i, ++it) {
+        const Task& first = it->second.front();
+        if (this->gate.can_start(first.inst, first.row))
+            return it;
+        if (first.inst.order != INIT_EMB)
+            break;
+    }
+    return queue.end();
+}
+
+AffinityExecutor::Task AffinityExecutor::take(Queue& queue, Queue::iterator key) {
+    Task task = std::move(key->second.front());
+    key->second.pop_front();
+    if (key->second.empty())
+        queue.erase(key);
+    return task;
+}
+
+void AffinityExecutor::worker_loop(int self) {
+    if (this->options.pin_workers) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(self % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    int n_workers = this->workers.size();
+    Worker& me = *this->workers[self];
+    std::unique_lock<std::mutex> lk(this->mutex);
+    while (true) {
+        // Own queue first, steal only when it has nothing that can start
+        int from = -1;
+        Queue::iterator key;
+        for (int i = 0; i < n_workers && from < 0; ++i) {
+            int w = (self + i) % n_workers;
+            key = this->startable(this->workers[w]->queue);
+            if (key != this->workers[w]->queue.end())
+                from = w;
+        }
+        if (from < 0) {
+            if (this->stopping)
+                return;
+            me.idle = true;
+            me.cv.wait(lk);
+            me.idle = false;
+            continue;
+        }
+
+        Task task = this->take(this->workers[from]->queue, key);
+        this->gate.start(task.inst);
+        this->stats.n_stolen += from != self;
+        auto last = this->last_worker.find(task.row);
+        if (last != this->last_worker.end()) {
+            ++this->stats.n_revisits;
+            this->stats.n_migrations += last->second != self;
+            last->second = self;
+        } else {
+            this->last_worker[task.row] = self;
+        }
+        lk.unlock();
+
+        this->handler(task.inst);
+
+        lk.lock();
+        this->gate.finish(task.inst);
+        ++this->stats.n_done;
+        if (--this->n_unfinished == 0)
+            this->idle_cv.notify_all();
+        if (task.inst.order != RECOMMEND) {
+            // The epoch frontier, or the rows appended, may have moved
+            for (auto& worker: this->workers) {
+                if (worker->idle)  worker->cv.notify_one();
+            }
+        }
+    }
+}
+
+AffinityStats AffinityExecutor::get_stats() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    return this->stats;
+}
+
+double AffinityExecutor::migration_rate() {
+    AffinityStats s = this->get_stats();
+    return s.n_revisits == 0? 0.0: (double) s.n_migrations / s.n_revisits;
+}
+
+void AffinityExecutor::report() {
+    AffinityStats s = this->get_stats();
+    std::cout << "affinity : " << s.n_done << " done, " << s.n_stolen
+              << " stolen, " << s.n_migrations << " of " << s.n_revisits
+              << " revisited rows migrated (" << this->migration_rate() * 100
+              << "%)\n";
+}
+
+} // namespace proj1
@@ -0,0 +1,88 @@
+#ifndef THREAD_LIB_AFFINITY_H_
+#define THREAD_LIB_AFFINITY_H_
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+#include "executor.h"
+#include "instruction.h"
+
+namespace proj1 {
+
+struct AffinityOptions {
+    AffinityOptions(): n_workers(16), pin_workers(false), first_new_row(0) {}
+    int n_workers;
+    bool pin_workers;   // pin worker i to cpu (i % number of cpus)
+    int first_new_row;  // index the first INIT will append at
+};
+
+struct AffinityStats {
+    long n_done;
+    long n_stolen;      // run by another worker than the home one
+    long n_revisits;    // rows that ran before
+    long n_migrations;  // ... on another worker than the last time
+};
+
+// The instruction's primary row: the user of an update or a recommend, the
+// appended user of an init (`new_row`, as the `EpochGate` assigns it).
+int primary_row(const Instruction& inst, int new_row);
+
+// Executor that keeps the instructions of a row on the same worker, so that
+// the row stays in that core's caches between updates. Each instruction is
+// hashed by its primary row to the queue of its home worker; a worker only
+// steals from other queues once its own has nothing that can start. The
+// epoch dependencies and the init order are kept as in `Executor`, by an
+// `EpochGate`, without priority classes.
+class AffinityExecutor {
+public:
+    using Handler = Executor::Handler;
+    AffinityExecutor(Handler handler, AffinityOptions options = AffinityOptions());
+    ~AffinityExecutor();
+    void submit(const Instruction& inst);
+    void run(const Instructions& insts);  // submits all at once and waits
+    void wait();
+    AffinityStats get_stats();
+    double migration_rate();  // of rows that ran before
+    void report();
+private:
+    struct Task {
+        Task(const Instruction& i, int r): inst(i), row(r) {}
+        Instruction inst;
+        int row;
+    };
+    // Keyed by 2 * epoch, plus one for recommends: they go after the updates
+    // of their epoch, which they wait for, and before those of the next one
+    using Queue = std::map<int, std::deque<Task> >;
+    struct Worker {
+        Queue queue;
+        std::condition_variable cv;
+        bool idle = false;
+    };
+
+    void submit_locked(const Instruction& inst);
+    // The key of the first task in `queue` that can start, or its end
+    Queue::iterator startable(Queue& queue);
+    Task take(Queue& queue, Queue::iterator key);
+    void worker_loop(int self);
+
+    Handler handler;
+    AffinityOptions options;
+    std::mutex mutex;
+    std::condition_variable idle_cv;
+    EpochGate gate;
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+    std::unordered_map<int, int> last_worker;  // row -> worker that ran it
+    long n_unfinished;
+    bool stopping;
+    AffinityStats stats;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_AFFINITY_H_
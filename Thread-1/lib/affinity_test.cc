@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include "affinity.h"
+
+namespace proj1 {
+namespace testing{
+
+AffinityOptions small_pool(int n_workers) {
+    AffinityOptions options;
+    options.n_workers = n_workers;
+    return options;
+}
+
+TEST(AffinityTest, test_rows_stay_home) {
+    std::mutex mutex;
+    std::map<int, std::thread::id> runner;  // user -> thread that ran it
+    int n_moved = 0;
+    AffinityExecutor executor([&] (const Instruction& inst) {
+        std::lock_guard<std::mutex> lk(mutex);
+        auto it = runner.find(inst.payloads[0]);
+        if (it == runner.end()) {
+            runner[inst.payloads[0]] = std::this_thread::get_id();
+        } else if (it->second != std::this_thread::get_id()) {
+            it->second = std::this_thread::get_id();
+            ++n_moved;
+        }
+    }, small_pool(4));
+    // One worker per row. A worker whose queue runs dry first may still
+    // steal the tail of another one, so a few moves are fine.
+    Instructions insts;
+    for (int i = 0; i < 400; ++i) {
+        insts.push_back(Instruction("1 " + std::to_string(i % 4) + " 1 0"));
+    }
+    executor.run(insts);
+    EXPECT_EQ(400, executor.get_stats().n_done);
+    EXPECT_EQ(n_moved, executor.get_stats().n_migrations);
+    EXPECT_LT(executor.migration_rate(), 0.1);
+}
+
+TEST(AffinityTest, test_epoch_order) {
+    std::mutex mutex;
+    std::vector<int> finished;
+    bool ok = true;
+    AffinityExecutor executor([&] (const Instruction& inst) {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (inst.order == UPDATE_EMB) {
+            for (int e: finished) ok = ok && e <= inst.epoch();
+            finished.push_back(inst.epoch());
+        } else if (inst.order == RECOMMEND) {
+            int n_needed = 0;
+            for (int e: finished) n_needed += e <= inst.epoch();
+            ok = ok && n_needed == 3 * (inst.epoch() + 1);
+        }
+    }, small_pool(3));
+    Instructions insts;
+    for (int epoch = 0; epoch < 5; ++epoch) {
+        std::string e = std::to_string(epoch);
+        insts.push_back(Instruction("2 1 " + e + " 1 2"));
+        for (int user = 0; user < 3; ++user) {
+            insts.push_back(Instruction("1 " + std::to_string(user) + " 1 0 " + e));
+        }
+        insts.push_back(Instruction("0 1 2"));
+    }
+    executor.run(insts);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(15u, finished.size());
+}
+
+TEST(AffinityTest, test_steals_when_dry) {
+    std::atomic<int> n_run(0);
+    AffinityExecutor executor([&] (const Instruction&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++n_run;
+    }, small_pool(4));
+    // Everything hashes to worker 0, the others have to steal to help
+    Instructions insts;
+    for (int i = 0; i < 100; ++i) {
+        insts.push_back(Instruction("1 0 1 0"));
+    }
+    executor.run(insts);
+    EXPECT_EQ(100, n_run.load());
+    EXPECT_GT(executor.get_stats().n_stolen, 0);
+}
+
+TEST(AffinityTest, test_inits_append_in_order) {
+    std::mutex mutex;
+    std::condition_variable appended;
+    int n_rows = 4;  // the user table the stream starts from
+    bool ok = true;
+    AffinityOptions options = small_pool(4);
+    options.first_new_row = n_rows;
+    AffinityExecutor executor([&] (const Instruction& inst) {
+        if (inst.order == INIT_EMB) {
+            // Slow enough for an init on another worker to overtake it, up
+            // to its append
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::unique_lock<std::mutex> lk(mutex);
+            ok = ok && inst.append_row == inst.payloads[0];  // the row it expects
+            // As `EmbeddingHolder::append_at`
+            appended.wait(lk, [&] { return n_rows >= inst.append_row; });
+            ok = ok && inst.append_row == n_rows;
+            ++n_rows;
+            appended.notify_all();
+        } else {
+            std::lock_guard<std::mutex> lk(mutex);
+            ok = ok && inst.payloads[0] < n_rows;
+        }
+    }, options);
+    // Each init is followed by instructions on the user it appends
+    Instructions insts;
+    for (int row = 4; row < 44; ++row) {
+        std::string user = std::to_string(row);
+        insts.push_back(Instruction("0 " + user));
+        insts.push_back(Instruction("1 " + user + " 0 1"));
+        insts.push_back(Instruction("2 " + user + " -1 0 1"));
+        insts.push_back(Instruction("1 " + std::to_string(row % 4) + " 1 0"));
+    }
+    executor.run(insts);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(44, n_rows);
+    EXPECT_EQ(160, executor.get_stats().n_done);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,203 @@
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "model.h"
+#include "transaction.h"
+#include "deterministic.h"
+
+namespace proj1 {
+
+namespace {
+
+struct RowRead {
+    EmbeddingHolder* holder;
+    int idx;
+    unsigned long version;
+};
+
+// The result of one instruction, waiting in the reorder buffer
+struct Speculation {
+    Speculation(): done(false), missing(false), new_user(nullptr),
+        user_gradient(nullptr), item_gradient(nullptr), recommendation(nullptr) {}
+    ~Speculation() { this->clear(); }
+    void clear() {
+        delete this->new_user;
+        delete this->user_gradient;
+        delete this->item_gradient;
+        delete this->recommendation;
+        this->new_user = this->user_gradient = this->item_gradient = nullptr;
+        this->recommendation = nullptr;
+        this->reads.clear();
+        this->missing = false;
+    }
+    bool done;
+    bool missing;  // an input row was not appended yet
+    std::vector<RowRead> reads;
+    Embedding* new_user;
+    EmbeddingGradient* user_gradient;
+    EmbeddingGradient* item_gradient;
+    Embedding* recommendation;
+};
+
+// A private copy of a row, remembering which version of it was read
+Embedding* read_row(EmbeddingHolder* holder, int idx, Speculation* spec) {
+    if (idx < 0 || idx >= (int) holder->get_n_embeddings()) {
+        spec->missing = true;
+        return nullptr;
+    }
+    Embedding* row = holder->get_embedding(idx);
+    std::lock_guard<Mutex> lk(holder->row_lock(idx));
+    Embedding* copy = new Embedding(row);
+    spec->reads.push_back(RowRead{holder, idx, copy->get_version()});
+    return copy;
+}
+
+// The same arithmetic as q0, on private copies
+void compute(const Instruction& inst, EmbeddingHolder* users,
+             EmbeddingHolder* items, Speculation* spec) {
+    switch(inst.order) {
+        case INIT_EMB: {
+            spec->new_user = new Embedding(users->get_emb_length());
+            for (int item_index: inst.payloads) {
+                Embedding* item = read_row(items, item_index, spec);
+                if (item == nullptr)  return;
+                EmbeddingGradient* gradient = cold_start(spec->new_user, item);
+                spec->new_user->update(gradient, 0.01);
+                delete gradient;
+                delete item;
+            }
+            break;
+        }
+        case UPDATE_EMB: {
+            Embedding* user = read_row(users, inst.payloads[0], spec);
+            Embedding* item = read_row(items, inst.payloads[1], spec);
+            if (user != nullptr && item != nullptr) {
+                int label = inst.payloads[2];
+                spec->user_gradient = calc_gradient(user, item, label);
+                user->update(spec->user_gradient, 0.01);
+                spec->item_gradient = calc_gradient(item, user, label);
+            }
+            delete user;
+            delete item;
+            break;
+        }
+        case RECOMMEND: {
+            Embedding* user = read_row(users, inst.payloads[0], spec);
+            std::vector<Embedding*> item_pool;
+            for (unsigned int i = 2; i < inst.payloads.size(); ++i) {
+                item_pool.push_back(read_row(items, inst.payloads[i], spec));
+            }
+            if (user != nullptr && !spec->missing)
+                spec->recommendation = recommend(user, item_pool);
+            for (Embedding* item: item_pool) {
+                if (item != spec->recommendation)
+                    delete item;
+            }
+            delete user;
+            break;
+        }
+    }
+}
+
+bool still_valid(const Speculation& spec) {
+    if (spec.missing)
+        return false;
+    // Only the committing thread updates rows, no need to lock to read versions
+    for (const RowRead& read: spec.reads) {
+        if (read.holder->get_embedding(read.idx)->get_version() != read.version)
+            return false;
+    }
+    return true;
+}
+
+void commit(const Instruction& inst, EmbeddingHolder* users,
+            EmbeddingHolder* items, Speculation* spec, OutputChannel* output) {
+    switch(inst.order) {
+        case INIT_EMB:
+            users->append(spec->new_user);
+            spec->new_user = nullptr;
+            break;
+        case UPDATE_EMB: {
+            RowTransaction txn;
+            txn.add(users, inst.payloads[0]).add(items, inst.payloads[1]).lock();
+            users->update_embedding(inst.payloads[0], spec->user_gradient, 0.01);
+            items->update_embedding(inst.payloads[1], spec->item_gradient, 0.001);
+            txn.unlock();
+            break;
+        }
+        case RECOMMEND:
+            if (output != nullptr) {
+                output->push(spec->recommendation);
+                spec->recommendation = nullptr;
+            } else {
+                spec->recommendation->write_to_stdout();
+            }
+            break;
+    }
+    spec->clear();
+}
+
+} // namespace
+
+DeterministicStats run_deterministic(const Instructions& insts,
+                                     EmbeddingHolder* users, EmbeddingHolder* items,
+                                     DeterministicOptions options,
+                                     OutputChannel* output) {
+    DeterministicStats stats = {0, 0};
+    size_t n = insts.size();
+    std::vector<Speculation> slots(n);  // the reorder buffer
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next = 0, committed = 0;
+    size_t window = std::max(1, options.window);
+
+    auto speculate = [&] {
+        std::unique_lock<std::mutex> lk(mutex);
+        while (true) {
+            cv.wait(lk, [&] { return next >= n || next < committed + window; });
+            if (next >= n)
+                return;
+            size_t i = next++;
+            lk.unlock();
+            compute(insts[i], users, items, &slots[i]);
+            lk.lock();
+            slots[i].done = true;
+            if (i == committed)
+                cv.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.n_workers; ++i) {
+        workers.emplace_back(speculate);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] { return slots[i].done; });
+        }
+        // Everything before `i` is committed, so the rows are exactly what
+        // the serial run would read here
+        if (!still_valid(slots[i])) {
+            slots[i].clear();
+            compute(insts[i], users, items, &slots[i]);
+            ++stats.n_recomputed;
+        }
+        commit(insts[i], users, items, &slots[i], output);
+        ++stats.n_committed;
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            ++committed;
+        }
+        cv.notify_all();
+    }
+
+    for (std::thread& worker: workers) {
+        worker.join();
+    }
+    return stats;
+}
+
+} // namespace proj1
@@ -0,0 +1,38 @@
+#ifndef THREAD_LIB_DETERMINISTIC_H_
+#define THREAD_LIB_DETERMINISTIC_H_
+
+#include "output.h"
+#include "embedding.h"
+#include "instruction.h"
+
+namespace proj1 {
+
+struct DeterministicOptions {
+    DeterministicOptions(): n_workers(16), window(256) {}
+    int n_workers;
+    int window;  // how far speculation may run ahead of the commit point
+};
+
+struct DeterministicStats {
+    long n_committed;
+    long n_recomputed;  // speculations whose inputs changed before commit
+};
+
+// Runs `insts` with the exact result of running them one by one in order, as
+// q0 does, bit for bit, including the order of the recommend outputs.
+//
+// Workers speculatively run the expensive part (`cold_start`,
+// `calc_gradient`, `recommend`) of upcoming instructions in parallel on
+// snapshots of their input rows, remembering the row versions they saw.
+// The results wait in a reorder buffer and are committed strictly in
+// instruction order. A result whose input rows were updated in between, by
+// an earlier instruction, is recomputed at commit time from the current
+// rows. Recommend results go to `output` when given, to stdout otherwise.
+DeterministicStats run_deterministic(const Instructions& insts,
+                                     EmbeddingHolder* users, EmbeddingHolder* items,
+                                     DeterministicOptions options = DeterministicOptions(),
+                                     OutputChannel* output = nullptr);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_DETERMINISTIC_H_
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "runner.h"
+#include "deterministic.h"
+
+namespace proj1 {
+namespace testing{
+
+// Runs `insts` both ways on fresh copies of q0.in and compares everything
+void expect_same_as_serial(const Instructions& insts, DeterministicOptions options) {
+    EmbeddingHolder users("data/q0.in"), items("data/q0.in");
+    EmbeddingHolder expected_users("data/q0.in"), expected_items("data/q0.in");
+    std::stringstream out, expected_out;
+    {
+        OutputChannel output(FlushPolicy(), out);
+        DeterministicStats stats = run_deterministic(insts, &users, &items, options, &output);
+        EXPECT_EQ((long) insts.size(), stats.n_committed);
+    }
+    {
+        OutputChannel output(FlushPolicy(), expected_out);
+        for (const Instruction& inst: insts) {
+            run_instruction(inst, &expected_users, &expected_items, &output);
+        }
+    }
+    EXPECT_TRUE(users == expected_users);
+    EXPECT_TRUE(items == expected_items);
+    EXPECT_EQ(expected_out.str(), out.str());
+}
+
+TEST(DeterministicTest, test_q0_instructions) {
+    Instructions insts = read_instructrions("data/q0_instruction.tsv");
+    expect_same_as_serial(insts, DeterministicOptions());
+}
+
+TEST(DeterministicTest, test_conflicting_rows) {
+    Instructions insts;
+    for (int i = 0; i < 500; ++i) {
+        // Few hot rows, so most speculations read a row an earlier one writes
+        insts.push_back(Instruction("1 " + std::to_string(i % 3) + " " +
+                                    std::to_string(i % 5) + " " + std::to_string(i % 2)));
+        if (i % 7 == 0)
+            insts.push_back(Instruction("2 " + std::to_string(i % 3) + " 0 1 2 3 4"));
+    }
+    DeterministicOptions options;
+    options.n_workers = 8;
+    expect_same_as_serial(insts, options);
+}
+
+TEST(DeterministicTest, test_reads_appended_user) {
+    Instructions insts;
+    for (int i = 0; i < 50; ++i) {
+        // Row 20 + i does not exist until the init before it is committed
+        insts.push_back(Instruction("0 " + std::to_string(i % 10) + " 3"));
+        insts.push_back(Instruction("1 " + std::to_string(20 + i) + " 4 1"));
+        insts.push_back(Instruction("2 " + std::to_string(20 + i) + " 0 1 2 3"));
+    }
+    DeterministicOptions options;
+    options.window = 16;
+    expect_same_as_serial(insts, options);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
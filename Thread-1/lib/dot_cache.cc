@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <iostream>
+#include "dot_cache.h"
+
+namespace proj1 {
+
+DotCache::DotCache(int capacity) :
+        entries(std::max(1, capacity)),
+        n_hits(0),
+        n_misses(0) {}
+
+size_t DotCache::slot(int user_idx, int item_idx) {
+    unsigned long key = ((unsigned long) (unsigned int) user_idx << 32) | (unsigned int) item_idx;
+    key *= 0x9e3779b97f4a7c15ul;  // Fibonacci hashing, spreads nearby indices
+    return (key >> 17) % this->entries.size();
+}
+
+bool DotCache::lookup(int user_idx, Embedding* user, int item_idx, Embedding* item, double* dot) {
+    size_t i = this->slot(user_idx, item_idx);
+    std::lock_guard<std::mutex> lk(this->stripe_mutex[i % kStripes]);
+    const Entry& entry = this->entries[i];
+    if (entry.user_idx == user_idx && entry.item_idx == item_idx &&
+            entry.user_version == user->get_version() &&
+            entry.item_version == item->get_version()) {
+        *dot = entry.dot;
+        this->n_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    this->n_misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void DotCache::insert(int user_idx, Embedding* user, int item_idx, Embedding* item, double dot) {
+    size_t i = this->slot(user_idx, item_idx);
+    std::lock_guard<std::mutex> lk(this->stripe_mutex[i % kStripes]);
+    Entry& entry = this->entries[i];
+    entry.user_idx = user_idx;
+    entry.item_idx = item_idx;
+    entry.user_version = user->get_version();
+    entry.item_version = item->get_version();
+    entry.dot = dot;
+}
+
+DotCacheStats DotCache::get_stats() {
+    DotCacheStats stats;
+    stats.n_hits = this->n_hits.load();
+    stats.n_misses = this->n_misses.load();
+    return stats;
+}
+
+double DotCache::hit_rate() {
+    DotCacheStats s = this->get_stats();
+    long n = s.n_hits + s.n_misses;
+    return n == 0? 0.0: (double) s.n_hits / n;
+}
+
+void DotCache::report() {
+    DotCacheStats s = this->get_stats();
+    std::cout << "dot cache : " << s.n_hits << " hits, " << s.n_misses
+              << " misses (" << this->hit_rate() * 100 << "% hit)\n";
+}
+
+} // namespace proj1
@@ -0,0 +1,51 @@
+#ifndef THREAD_LIB_DOT_CACHE_H_
+#define THREAD_LIB_DOT_CACHE_H_
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "embedding.h"
+
+namespace proj1 {
+
+struct DotCacheStats {
+    long n_hits;
+    long n_misses;  // including the entries found stale
+};
+
+// A bounded cache of (user row, item row) dot products, for the repeated
+// recommends of a user over an item pool that did not change in between.
+//
+// Entries are keyed by the row indices and remember the versions of both
+// rows they were computed from, an update of either row makes them stale.
+// The table is direct-mapped: a new entry simply replaces the one in its
+// slot. One cache must only ever be used with the same user and item holders.
+class DotCache {
+public:
+    explicit DotCache(int capacity = 1 << 16);
+    bool lookup(int user_idx, Embedding* user, int item_idx, Embedding* item, double* dot);
+    void insert(int user_idx, Embedding* user, int item_idx, Embedding* item, double dot);
+    DotCacheStats get_stats();
+    double hit_rate();
+    void report();
+private:
+    struct Entry {
+        int user_idx = -1;
+        int item_idx = -1;
+        unsigned long user_version = 0;
+        unsigned long item_version = 0;
+        double dot = 0;
+    };
+    static const int kStripes = 64;
+
+    size_t slot(int user_idx, int item_idx);
+
+    std::vector<Entry> entries;
+    std::mutex stripe_mutex[kStripes];  // slot i is guarded by i % kStripes
+    std::atomic<long> n_hits;
+    std::atomic<long> n_misses;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_DOT_CACHE_H_
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "model.h"
+#include "dot_cache.h"
+
+namespace proj1 {
+namespace testing{
+
+Embedding* make_row(int length, double offset) {
+    double* data = new double[length];
+    for (int i = 0; i < length; ++i) {
+        data[i] = std::sin(i + offset);
+    }
+    return new Embedding(length, data);
+}
+
+TEST(DotCacheTest, test_squared_norm_follows_updates) {
+    Embedding* row = make_row(8, 0.5);
+    Embedding* gradient = make_row(8, 2.0);
+    row->get_squared_norm();
+    row->update(gradient, 0.1);
+    Embedding fresh(row);
+    double expected = 0;
+    for (int i = 0; i < 8; ++i) {
+        expected += row->get_data()[i] * row->get_data()[i];
+    }
+    EXPECT_DOUBLE_EQ(expected, row->get_squared_norm());
+    EXPECT_DOUBLE_EQ(expected, fresh.get_squared_norm());
+    delete row;
+    delete gradient;
+}
+
+TEST(DotCacheTest, test_stale_after_update) {
+    DotCache cache(16);
+    Embedding* user = make_row(8, 0.0);
+    Embedding* item = make_row(8, 1.0);
+    double d;
+    EXPECT_FALSE(cache.lookup(3, user, 5, item, &d));
+    cache.insert(3, user, 5, item, dot(user, item));
+    EXPECT_TRUE(cache.lookup(3, user, 5, item, &d));
+    EXPECT_DOUBLE_EQ(dot(user, item), d);
+    // Same rows under other indices are other entries
+    EXPECT_FALSE(cache.lookup(5, user, 3, item, &d));
+    item->update(user, 0.01);
+    EXPECT_FALSE(cache.lookup(3, user, 5, item, &d));
+    EXPECT_EQ(1, cache.get_stats().n_hits);
+    EXPECT_EQ(3, cache.get_stats().n_misses);
+    delete user;
+    delete item;
+}
+
+TEST(DotCacheTest, test_cached_recommend_same_as_plain) {
+    DotCache cache(64);  // fewer slots than pairs, entries get replaced
+    Embedding* user = make_row(16, 0.0);
+    std::vector<Embedding*> pool;
+    std::vector<int> idxs;
+    for (int i = 0; i < 100; ++i) {
+        pool.push_back(make_row(16, 0.37 * i));
+        idxs.push_back(i);
+    }
+    for (int round = 0; round < 3; ++round) {
+        EXPECT_EQ(recommend(user, pool), recommend(user, 0, pool, idxs, &cache));
+        pool[round]->update(user, 0.5);
+    }
+    EXPECT_GT(cache.get_stats().n_hits, 0);
+    delete user;
+    for (Embedding* item: pool) delete item;
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
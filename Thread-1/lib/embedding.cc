@@ -4,10 +4,17 @@
 #include <cmath>
 
 #include "utils.h"
+#include "perf_counters.h"
 #include "embedding.h"
 
 namespace proj1 {
 
+namespace {
+
+PerfRegion holder_read_region("EmbeddingHolder::read");
+
+} // namespace
+
 Embedding::Embedding(int length) {
     this->data = new double[length];
     for (int i = 0; i < length; ++i) {
@@ -22,6 +29,11 @@ Embedding::Embedding(int length, double* data) {
     this->data = data;
 }
 
+Embedding::Embedding(int length, double* data, bool owns_data) :
+        Embedding(length, data) {
+    this->owns_data = owns_data;
+}
+
 Embedding::Embedding(Embedding* origin) {
 	int length = origin->get_length();
     embbedingAssert(length > 0, "Non-positive length encountered!", NON_POSITIVE_LEN);
@@ -30,6 +42,9 @@ Embedding::Embedding(Embedding* origin) {
     for(int i = 0; i<length; i++)newData[i] = oldData[i];
     this->length = length;
     this->data = newData;
+    this->version = origin->version;
+    this->has_norm = origin->has_norm;
+    this->squared_norm = origin->squared_norm;
 }
 
 Embedding::Embedding(int length, std::string raw) {
@@ -52,9 +67,25 @@ Embedding::Embedding(int length, std::string raw) {
 void Embedding::update(Embedding* gradient, double stepsize) {
     embbedingAssert(gradient->length == this->length,
            "Gradient has different length from the embedding!", LEN_MISMATCH);
+    double squared_norm = 0;
     for (int i = 0; i < this->length; ++i) {
         this->data[i] -= stepsize * gradient->data[i];
+        squared_norm += this->data[i] * this->data[i];
     }
+    this->squared_norm = squared_norm;
+    this->has_norm = true;
+    ++this->version;
+}
+
+double Embedding::get_squared_norm() {
+    if (!this->has_norm) {
+        this->squared_norm = 0;
+        for (int i = 0; i < this->length; ++i) {
+            this->squared_norm += this->data[i] * this->data[i];
+        }
+        this->has_norm = true;
+    }
+    return this->squared_norm;
 }
 
 std::string Embedding::to_string() {
@@ -142,15 +173,33 @@ bool Embedding::operator==(const Embedding &another) {
     return true;
 }
 
+// The norms of the rows are computed up front, so that readers never race
+// on filling them in lazily
 EmbeddingHolder::EmbeddingHolder(std::string filename) {
-    this->emb_matx = this->read(filename);
+    this->name_locks();
+    for (Embedding* emb: this->read(filename)) {
+        emb->get_squared_norm();
+        this->push(emb);
+    }
 }
 
 EmbeddingHolder::EmbeddingHolder(std::vector<Embedding*> &data) {
-    this->emb_matx = data;
+    this->name_locks();
+    for (Embedding* emb: data) {
+        emb->get_squared_norm();
+        this->push(emb);
+    }
+}
+
+void EmbeddingHolder::name_locks() {
+    set_lock_name(this->matx_mutex, "holder layout");
+    for (int i = 0; i < kRowLockStripes; ++i) {
+        set_lock_name(this->row_mutex[i], "row stripe", i);
+    }
 }
 
 EmbeddingMatrix EmbeddingHolder::read(std::string filename) {
+    PerfScope perf(holder_read_region);
     std::string line;
     std::ifstream ifs(filename);
     int length = 0;
@@ -173,21 +222,53 @@ EmbeddingMatrix EmbeddingHolder::read(std::string filename) {
     return matrix;
 }
 
+// Only one thread at a time, the others may be reading
+void EmbeddingHolder::push(Embedding* data) {
+    int indx = this->n_rows.load(std::memory_order_relaxed);
+    if (indx == kMaxRowChunks * kRowChunkSize)
+        throw std::runtime_error("Too many embeddings in one holder!");
+    Embedding**& chunk = this->chunks[indx >> kRowChunkBits];
+    if (chunk == nullptr)
+        chunk = new Embedding*[kRowChunkSize];
+    chunk[indx & (kRowChunkSize - 1)] = data;
+    this->n_rows.store(indx + 1, std::memory_order_release);
+}
+
 int EmbeddingHolder::append(Embedding* data) {
-    int indx = this->emb_matx.size();
+    std::lock_guard<Mutex> lk(this->matx_mutex);
+    int indx = this->n_rows.load(std::memory_order_relaxed);
     embbedingAssert(
-        data->get_length() == this->emb_matx[0]->get_length(),
+        data->get_length() == this->get_embedding(0)->get_length(),
         "Embedding to append has a different length!", LEN_MISMATCH
     );
-    this->emb_matx.push_back(data);
+    data->get_squared_norm();
+    this->push(data);
+    this->appended_cv.notify_all();
     return indx;
 }
 
+int EmbeddingHolder::append_at(int idx, Embedding* data) {
+    std::unique_lock<Mutex> lk(this->matx_mutex);
+    this->appended_cv.wait(lk, [this, idx] {
+        return this->n_rows.load(std::memory_order_relaxed) >= idx;
+    });
+    if (this->n_rows.load(std::memory_order_relaxed) != idx)
+        throw std::runtime_error("Row " + std::to_string(idx) + " is taken already!");
+    embbedingAssert(
+        data->get_length() == this->get_embedding(0)->get_length(),
+        "Embedding to append has a different length!", LEN_MISMATCH
+    );
+    data->get_squared_norm();
+    this->push(data);
+    this->appended_cv.notify_all();
+    return idx;
+}
+
 void EmbeddingHolder::write(std::string filename) {
     std::ofstream ofs(filename);
     if (ofs.is_open()) {
-        for (Embedding* emb: this->emb_matx) {
-            ofs << emb->to_string() << '\n';
+        for (int i = 0; i < (int)this->get_n_embeddings(); ++i) {
+            ofs << this->get_embedding(i)->to_string() << '\n';
         }
         ofs.close();
     } else {
@@ -197,27 +278,30 @@ void EmbeddingHolder::write(std::string filename) {
 
 void EmbeddingHolder::write_to_stdout() {
     std::string prefix("[OUTPUT]");
-    for (Embedding* emb: this->emb_matx) {
-        std::cout << prefix << emb->to_string() << '\n';
+    for (int i = 0; i < (int)this->get_n_embeddings(); ++i) {
+        std::cout << prefix << this->get_embedding(i)->to_string() << '\n';
     }
 }
 
 EmbeddingHolder::~EmbeddingHolder() {
-    for (Embedding* emb: this->emb_matx) {
-        delete emb;
+    for (int i = 0; i < (int)this->get_n_embeddings(); ++i) {
+        delete this->get_embedding(i);
+    }
+    for (Embedding** chunk: this->chunks) {
+        delete []chunk;
     }
 }
 
 void EmbeddingHolder::update_embedding(
         int idx, EmbeddingGradient* gradient, double stepsize) {
-    this->emb_matx[idx]->update(gradient, stepsize);
+    this->get_embedding(idx)->update(gradient, stepsize);
 }
 
 bool EmbeddingHolder::operator==(const EmbeddingHolder &another) {
-    if (this->get_n_embeddings() != another.emb_matx.size())
+    if (this->get_n_embeddings() != another.get_n_embeddings())
         return false;
-    for (int i = 0; i < (int)this->emb_matx.size(); ++i) {
-        if(!(*(this->emb_matx[i]) == *(another.get_embedding(i)))){
+    for (int i = 0; i < (int)this->get_n_embeddings(); ++i) {
+        if(!(*(this->get_embedding(i)) == *(another.get_embedding(i)))){
         	return false;
 		}
     }
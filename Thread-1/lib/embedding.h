@@ -1,8 +1,11 @@
 #ifndef THREAD_LIB_EMBEDDING_H_
 #define THREAD_LIB_EMBEDDING_H_
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
+#include "lock_profile.h"
 
 namespace proj1 {
 
@@ -16,11 +19,18 @@ public:
     Embedding() {}
     Embedding(int);  // Random init an embedding
     Embedding(int, double*);
+    Embedding(int, double*, bool owns_data);  // e.g. rows in shared memory
     Embedding(int, std::string);
     Embedding(Embedding*);
-    ~Embedding() { delete []this->data; }
+    ~Embedding() { if (this->owns_data) delete []this->data; }
     double* get_data() { return this->data; }
     int get_length() { return this->length; }
+    // Bumped by every `update`, so a reader can tell whether the row changed
+    // since it last looked. Copies start from the version of their origin.
+    unsigned long get_version() { return this->version; }
+    // Sum of the squares of the elements, computed once and then kept up to
+    // date by `update`.
+    double get_squared_norm();
     void update(Embedding*, double);
     std::string to_string();
     void write_to_stdout();
@@ -37,11 +47,25 @@ public:
 private:
     int length;
     double* data;
+    bool owns_data = true;
+    unsigned long version = 0;
+    bool has_norm = false;
+    double squared_norm = 0;
 };
 
 using EmbeddingMatrix = std::vector<Embedding*>;
 using EmbeddingGradient = Embedding;
 
+// Rows are guarded by a fixed table of striped locks, so that the table never
+// has to grow (and move) while another thread is holding one of them.
+const int kRowLockStripes = 1024;
+
+// Rows are kept in chunks that never move once allocated, so that they can be
+// looked up without a lock while `append` adds more.
+const int kRowChunkBits = 12;
+const int kRowChunkSize = 1 << kRowChunkBits;
+const int kMaxRowChunks = 4096;  // 16M rows
+
 class EmbeddingHolder{
 public:
     EmbeddingHolder(std::string filename);
@@ -51,15 +75,35 @@ public:
     void write_to_stdout();
     void write(std::string filename);
     int append(Embedding *data);
+    // Appends `data` as row `idx` once the rows before it are in, so that
+    // inits computed concurrently still get the rows they would get in order
+    int append_at(int idx, Embedding *data);
     void update_embedding(int, EmbeddingGradient*, double);
-    Embedding* get_embedding(int idx) const { return this->emb_matx[idx]; } 
-    unsigned int get_n_embeddings() { return this->emb_matx.size(); }
+    // Lock-free: `idx` must be below a count from `get_n_embeddings`, or have
+    // been returned by an `append` that happened before.
+    Embedding* get_embedding(int idx) const {
+        return this->chunks[idx >> kRowChunkBits][idx & (kRowChunkSize - 1)];
+    }
+    unsigned int get_n_embeddings() const {
+        return this->n_rows.load(std::memory_order_acquire);
+    }
     int get_emb_length() {
-        return this->emb_matx.empty()? 0: this->get_embedding(0)->get_length();
+        return this->get_n_embeddings() == 0? 0: this->get_embedding(0)->get_length();
+    }
+    // The lock that must be held while reading or updating row `idx`.
+    // NOTE: several rows share one stripe, never lock two rows one by one.
+    Mutex& row_lock(int idx) {
+        return this->row_mutex[idx % kRowLockStripes];
     }
     bool operator==(const EmbeddingHolder&);
 private:
-    EmbeddingMatrix emb_matx;
+    Embedding** chunks[kMaxRowChunks] = {};
+    std::atomic<int> n_rows{0};  // published after the row is in its chunk
+    void name_locks();
+    void push(Embedding*);
+    Mutex matx_mutex;  // serializes appends
+    ConditionVariable appended_cv;  // for `append_at`, on `matx_mutex`
+    Mutex row_mutex[kRowLockStripes];
 };
 
 } // namespace proj1
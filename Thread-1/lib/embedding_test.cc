@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
 #include <vector>
 #include "embedding.h"
 
@@ -58,6 +60,18 @@ TEST_F(EmbeddingTest, test_embdeddingHolder){
 	EXPECT_EQ((*embh_testC) == (*embh_testA), false);
 }
 
+TEST_F(EmbeddingTest, test_append_at_waits_for_the_rows_before){
+	std::thread later([this] {
+		EXPECT_EQ(2, embh_testA->append_at(2, new Embedding(emb_testC)));
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EXPECT_EQ(1u, embh_testA->get_n_embeddings());
+	EXPECT_EQ(1, embh_testA->append_at(1, new Embedding(emb_testB)));
+	later.join();
+	EXPECT_EQ(3u, embh_testA->get_n_embeddings());
+	EXPECT_EQ((*embh_testA->get_embedding(1)) == (*emb_testB), true);
+}
+
 } // namespace testing
 } // namespace proj1
 
@@ -0,0 +1,258 @@
+#include <climits>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "trace.h"
+#include "perf_counters.h"
+#include "executor.h"
+
+namespace proj1 {
+
+namespace {
+
+const double kEwmaWeight = 0.1;
+const char* kClassNames[N_PRIORITY_CLASSES] = {"latency", "background"};
+PerfRegion worker_region("executor worker");
+
+} // namespace
+
+PriorityClass priority_of(const Instruction& inst) {
+    return inst.order == RECOMMEND? LATENCY_CLASS: BACKGROUND_CLASS;
+}
+
+EpochGate::EpochGate(int first_new_row) :
+        track_rows(first_new_row >= 0),
+        next_new_row(std::max(0, first_new_row)),
+        next_start(std::max(0, first_new_row)),
+        n_rows(std::max(0, first_new_row)) {}
+
+int EpochGate::submit(const Instruction& inst) {
+    if (inst.order == INIT_EMB)
+        return this->next_new_row++;
+    if (inst.order == UPDATE_EMB)
+        ++this->pending_updates[inst.epoch()];
+    return -1;
+}
+
+void EpochGate::start(const Instruction& inst) {
+    if (inst.order == INIT_EMB)
+        ++this->next_start;
+}
+
+void EpochGate::finish(const Instruction& inst) {
+    if (inst.order == INIT_EMB) {
+        ++this->n_rows;
+        return;
+    }
+    if (inst.order != UPDATE_EMB)  return;
+    auto it = this->pending_updates.find(inst.epoch());
+    if (--it->second == 0)
+        this->pending_updates.erase(it);
+}
+
+bool EpochGate::can_start(const Instruction& inst, int new_row) {
+    if (inst.order == INIT_EMB)
+        return !this->track_rows || new_row == this->next_start;
+    // A user no init appends is left to the runner: it exists, or it is bad
+    int user = inst.payloads.empty()? -1: inst.payloads[0];
+    if (this->track_rows && user >= this->n_rows && user < this->next_new_row)
+        return false;
+    // The smallest epoch that still has unfinished updates
+    int frontier = this->pending_updates.empty()?
+        INT_MAX: this->pending_updates.begin()->first;
+    return inst.order == RECOMMEND? inst.epoch() < frontier: inst.epoch() <= frontier;
+}
+
+ExecutorOptions::ExecutorOptions() :
+        n_workers(16),
+        n_reserved_workers(2),
+        first_new_row(0) {
+    this->slo_usec[LATENCY_CLASS] = 50 * 1000;
+    this->slo_usec[BACKGROUND_CLASS] = 60 * 1000 * 1000;
+}
+
+Executor::Executor(Handler handler, ExecutorOptions options) :
+        handler(std::move(handler)),
+        options(options),
+        gate(options.first_new_row),
+        n_unfinished(0),
+        n_background_running(0),
+        stopping(false) {
+    int n_reserved = std::max(0, options.n_reserved_workers);
+    this->n_shared_workers = std::max(1, options.n_workers - n_reserved);
+    this->background_limit = this->n_shared_workers;
+    memset(this->stats, 0, sizeof(this->stats));
+    for (int i = 0; i < n_reserved; ++i) {
+        this->workers.emplace_back(&Executor::worker_loop, this, true);
+    }
+    for (int i = 0; i < this->n_shared_workers; ++i) {
+        this->workers.emplace_back(&Executor::worker_loop, this, false);
+    }
+}
+
+Executor::~Executor() {
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->stopping = true;
+    }
+    this->work_cv.notify_all();
+    for (std::thread& worker: this->workers) {
+        worker.join();
+    }
+}
+
+void Executor::submit_locked(const Instruction& inst, Work work) {
+    int new_row = this->gate.submit(inst);
+    Task task(inst, std::move(work), new_row);
+    if (inst.order == INIT_EMB && this->gate.tracks_rows())
+        task.inst.append_row = new_row;
+    this->lanes[priority_of(inst)][inst.epoch()].push_back(std::move(task));
+    ++this->n_unfinished;
+}
+
+void Executor::submit(const Instruction& inst) {
+    this->submit(inst, Work());
+}
+
+void Executor::submit(const Instruction& inst, Work work) {
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->submit_locked(inst, std::move(work));
+    }
+    this->work_cv.notify_all();
+}
+
+void Executor::run(const Instructions& insts) {
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        for (const Instruction& inst: insts) {
+            this->submit_locked(inst, Work());
+        }
+    }
+    this->work_cv.notify_all();
+    this->wait();
+}
+
+void Executor::wait() {
+    std::unique_lock<std::mutex> lk(this->mutex);
+    this->idle_cv.wait(lk, [this] { return this->n_unfinished == 0; });
+}
+
+bool Executor::can_start(Lane::iterator epoch) {
+    const Task& task = epoch->second.front();
+    return this->gate.can_start(task.inst, task.new_row);
+}
+
+bool Executor::next_lane(bool reserved, PriorityClass* cls, Lane::iterator* epoch) {
+    // Lanes are ordered by epoch, so only their first epoch can be ready
+    Lane& latency = this->lanes[LATENCY_CLASS];
+    if (!latency.empty() && this->can_start(latency.begin())) {
+        *cls = LATENCY_CLASS;
+        *epoch = latency.begin();
+        return true;
+    }
+    if (reserved || this->n_background_running >= this->background_limit)
+        return false;
+    // Inits come first, but while one waits for the inits before it to start
+    // the updates of the first epoch may go
+    Lane& background = this->lanes[BACKGROUND_CLASS];
+    auto it = background.begin();
+    if (it != background.end() && it->first < 0 && !this->can_start(it))
+        ++it;
+    if (it != background.end() && this->can_start(it)) {
+        *cls = BACKGROUND_CLASS;
+        *epoch = it;
+        return true;
+    }
+    return false;
+}
+
+void Executor::finish(PriorityClass cls, const Instruction& inst, long usec) {
+    this->gate.finish(inst);
+    if (cls == BACKGROUND_CLASS)
+        --this->n_background_running;
+
+    ClassStats& s = this->stats[cls];
+    bool violated = usec > this->options.slo_usec[cls];
+    s.ewma_usec = s.n_done == 0? usec:
+        (1 - kEwmaWeight) * s.ewma_usec + kEwmaWeight * usec;
+    ++s.n_done;
+    s.total_usec += usec;
+    s.max_usec = std::max(s.max_usec, usec);
+    s.n_slo_violations += violated;
+
+    // Admission control: back off the background lane multiplicatively when
+    // recommends miss their target, and give it room back additively when
+    // they meet it (or when the background work itself starts to starve).
+    if (cls == LATENCY_CLASS && violated) {
+        this->background_limit = std::max(1, this->background_limit / 2);
+    } else if (cls == LATENCY_CLASS || violated) {
+        this->background_limit = std::min(
+            this->n_shared_workers, this->background_limit + 1);
+    }
+
+    if (--this->n_unfinished == 0)
+        this->idle_cv.notify_all();
+}
+
+void Executor::worker_loop(bool reserved) {
+    PerfScope perf(worker_region);
+    std::unique_lock<std::mutex> lk(this->mutex);
+    while (true) {
+        PriorityClass cls;
+        Lane::iterator epoch;
+        this->work_cv.wait(lk, [this, reserved, &cls, &epoch] {
+            return this->stopping || this->next_lane(reserved, &cls, &epoch);
+        });
+        if (this->stopping)
+            return;
+        std::deque<Task>& queue = epoch->second;
+        Task task = std::move(queue.front());
+        queue.pop_front();
+        if (queue.empty())
+            this->lanes[cls].erase(epoch);
+        if (cls == BACKGROUND_CLASS)
+            ++this->n_background_running;
+        this->gate.start(task.inst);
+        lk.unlock();
+        trace_complete("queued", "queue", task.submitted_usec, usec_since_start());
+
+        if (task.work) {
+            task.work();
+        } else {
+            this->handler(task.inst);
+        }
+
+        long usec = usec_since_start() - task.submitted_usec;
+        lk.lock();
+        this->finish(cls, task.inst, usec);
+        // Finishing may move the epoch frontier or the background limit
+        this->work_cv.notify_all();
+    }
+}
+
+ClassStats Executor::get_stats(PriorityClass cls) {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    return this->stats[cls];
+}
+
+int Executor::get_background_limit() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    return this->background_limit;
+}
+
+void Executor::report() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    for (int cls = 0; cls < N_PRIORITY_CLASSES; ++cls) {
+        const ClassStats& s = this->stats[cls];
+        if (s.n_done == 0)  continue;
+        std::cout << kClassNames[cls] << " : " << s.n_done << " done, avg "
+                  << (long) (s.total_usec / s.n_done) << " usec, max "
+                  << s.max_usec << " usec, " << s.n_slo_violations
+                  << " over the " << this->options.slo_usec[cls]
+                  << " usec SLO\n";
+    }
+}
+
+} // namespace proj1
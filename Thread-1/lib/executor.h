@@ -0,0 +1,137 @@
+#ifndef THREAD_LIB_EXECUTOR_H_
+#define THREAD_LIB_EXECUTOR_H_
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "utils.h"
+#include "instruction.h"
+
+namespace proj1 {
+
+enum PriorityClass {
+    LATENCY_CLASS = 0,   // RECOMMEND, the user is waiting for it
+    BACKGROUND_CLASS,    // INIT_EMB and UPDATE_EMB, embedding maintenance
+    N_PRIORITY_CLASSES
+};
+
+PriorityClass priority_of(const Instruction& inst);
+
+struct ExecutorOptions {
+    ExecutorOptions();
+    int n_workers;           // total number of worker threads
+    int n_reserved_workers;  // workers that only serve the latency lane
+    int first_new_row;       // index the first INIT will append at, see EpochGate
+    long slo_usec[N_PRIORITY_CLASSES];  // latency target of each class
+};
+
+// Tracks the updates that are submitted but not finished yet, to tell which
+// instructions the epoch dependencies of the spec allow to start: an update
+// waits for all updates of smaller epochs, a recommend for all updates up to
+// its epoch.
+//
+// Every init gets the row it would get from q0, the next one in submit order:
+// executors pass it on as the instruction's `append_row`. Inits start in that
+// order too, and then run concurrently, cold starts included; only their
+// appends wait for each other (`EmbeddingHolder::append_at`), and each one
+// only for inits that started before it. An update or a recommend of a user
+// appended by an init waits until that init is done. With a negative
+// `first_new_row` the rows are not tracked: inits run in any order, append
+// at the end and nothing waits for them, for callers that check the rows
+// themselves. Not thread-safe.
+class EpochGate {
+public:
+    explicit EpochGate(int first_new_row = 0);
+    // Returns the row an init will append, -1 for the other orders
+    int submit(const Instruction& inst);
+    void start(const Instruction& inst);
+    void finish(const Instruction& inst);
+    // `new_row` as returned by `submit`
+    bool can_start(const Instruction& inst, int new_row);
+    bool tracks_rows() const { return this->track_rows; }
+private:
+    std::map<int, int> pending_updates;  // epoch -> updates not done yet
+    bool track_rows;
+    int next_new_row;  // of the next init submitted
+    int next_start;    // of the next init to start
+    // Rows appended so far, as counted by the inits that are done: since the
+    // appends are in order, every row below it is in
+    int n_rows;
+};
+
+struct ClassStats {
+    long n_done;
+    long n_slo_violations;
+    long max_usec;
+    double total_usec;
+    double ewma_usec;
+};
+
+// Runs instructions on a pool of workers with one queue (lane) per priority
+// class, and keeps the epoch dependencies of the spec: an update waits for all
+// updates of smaller epochs, a recommend for all updates up to its epoch.
+// Inits and the instructions on their rows are ordered by the `EpochGate`.
+//
+// Reserved workers never pick up background work, and shared workers always
+// look at the latency lane first, so background instructions yield to pending
+// recommends at every instruction boundary. The number of background
+// instructions in flight is adapted (AIMD) to keep the latency class within
+// its SLO.
+class Executor {
+public:
+    using Handler = std::function<void(const Instruction&)>;
+    using Work = std::function<void()>;
+    Executor(Handler handler, ExecutorOptions options = ExecutorOptions());
+    ~Executor();
+    void submit(const Instruction& inst);
+    // Schedules `work` as if it were `inst` (same lane, same epoch gate) and
+    // runs it instead of the handler, e.g. to send a reply once `inst` is done
+    void submit(const Instruction& inst, Work work);
+    // Submits a whole batch at once, so that epoch dependencies on later
+    // instructions of the batch are known before anything starts, and waits
+    void run(const Instructions& insts);
+    void wait();  // until everything submitted so far is done
+    ClassStats get_stats(PriorityClass cls);
+    int get_background_limit();
+    void report();
+private:
+    struct Task {
+        Task(const Instruction& i, Work w, int r):
+            inst(i), work(std::move(w)), new_row(r),
+            submitted_usec(usec_since_start()) {}
+        Instruction inst;
+        Work work;  // empty to run the handler
+        int new_row;  // the row an init appends
+        long submitted_usec;  // on the (possibly simulated) program clock
+    };
+    using Lane = std::map<int, std::deque<Task> >;  // keyed by epoch
+
+    void submit_locked(const Instruction& inst, Work work);
+    bool can_start(Lane::iterator epoch);
+    bool next_lane(bool reserved, PriorityClass* cls, Lane::iterator* epoch);
+    void finish(PriorityClass cls, const Instruction& inst, long usec);
+    void worker_loop(bool reserved);
+
+    Handler handler;
+    ExecutorOptions options;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable idle_cv;
+    Lane lanes[N_PRIORITY_CLASSES];
+    EpochGate gate;
+    long n_unfinished;
+    int n_background_running;
+    int background_limit;
+    int n_shared_workers;
+    bool stopping;
+    ClassStats stats[N_PRIORITY_CLASSES];
+    std::vector<std::thread> workers;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_EXECUTOR_H_
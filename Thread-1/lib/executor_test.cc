@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "executor.h"
+
+namespace proj1 {
+namespace testing{
+
+ExecutorOptions small_pool(int n_workers, int n_reserved) {
+    ExecutorOptions options;
+    options.n_workers = n_workers;
+    options.n_reserved_workers = n_reserved;
+    return options;
+}
+
+TEST(ExecutorTest, test_runs_everything_once) {
+    std::atomic<int> n_run(0);
+    Executor executor([&n_run] (const Instruction&) { ++n_run; }, small_pool(4, 1));
+    Instructions insts;
+    for (int i = 0; i < 100; ++i) {
+        insts.push_back(Instruction(i % 3 == 0? "2 0 -1 1 2": "1 0 1 0"));
+    }
+    executor.run(insts);
+    EXPECT_EQ(100, n_run.load());
+    EXPECT_EQ(34, executor.get_stats(LATENCY_CLASS).n_done);
+    EXPECT_EQ(66, executor.get_stats(BACKGROUND_CLASS).n_done);
+}
+
+TEST(ExecutorTest, test_epoch_order) {
+    std::mutex mutex;
+    std::vector<int> finished;  // epochs of finished updates, in order
+    bool ok = true;
+    Executor executor([&] (const Instruction& inst) {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (inst.order == UPDATE_EMB) {
+            for (int e: finished) ok = ok && e <= inst.epoch();
+            finished.push_back(inst.epoch());
+        } else {
+            // A recommend must see every update up to its epoch
+            int n_needed = 0;
+            for (int e: finished) n_needed += e <= inst.epoch();
+            ok = ok && n_needed == 4 * (inst.epoch() + 1);
+        }
+    }, small_pool(8, 2));
+    Instructions insts;
+    for (int epoch = 0; epoch < 5; ++epoch) {
+        // The recommend comes before the updates it depends on
+        insts.push_back(Instruction("2 0 " + std::to_string(epoch) + " 1 2"));
+        for (int i = 0; i < 4; ++i) {
+            insts.push_back(Instruction("1 0 1 0 " + std::to_string(epoch)));
+        }
+    }
+    executor.run(insts);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(20u, finished.size());
+}
+
+TEST(ExecutorTest, test_recommend_not_blocked_by_updates) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool recommended = false;
+    Executor executor([&] (const Instruction& inst) {
+        std::unique_lock<std::mutex> lk(mutex);
+        if (inst.order == RECOMMEND) {
+            recommended = true;
+            cv.notify_all();
+        } else {
+            // Updates hold every shared worker until the recommend is out
+            cv.wait(lk, [&] { return recommended; });
+        }
+    }, small_pool(3, 1));
+    for (int i = 0; i < 4; ++i) {
+        executor.submit(Instruction("1 0 1 0"));
+    }
+    executor.submit(Instruction("2 0 -1 1 2"));
+    executor.wait();
+    EXPECT_TRUE(recommended);
+}
+
+TEST(ExecutorTest, test_admission_backs_off) {
+    ExecutorOptions options = small_pool(8, 1);
+    options.slo_usec[LATENCY_CLASS] = -1;  // every recommend misses
+    Executor executor([] (const Instruction&) {}, options);
+    for (int i = 0; i < 3; ++i) {
+        executor.submit(Instruction("2 0 -1 1 2"));
+        executor.wait();
+    }
+    EXPECT_EQ(1, executor.get_background_limit());
+}
+
+TEST(ExecutorTest, test_inits_append_in_order) {
+    std::mutex mutex;
+    std::condition_variable appended;
+    int n_rows = 2;  // the user table the stream starts from
+    bool ok = true;
+    ExecutorOptions options = small_pool(8, 2);
+    options.first_new_row = n_rows;
+    Executor executor([&] (const Instruction& inst) {
+        if (inst.order == INIT_EMB) {
+            // Slow enough for a later init to overtake it, up to its append
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            std::unique_lock<std::mutex> lk(mutex);
+            ok = ok && inst.append_row == inst.payloads[0];  // the row it expects
+            // As `EmbeddingHolder::append_at`
+            appended.wait(lk, [&] { return n_rows >= inst.append_row; });
+            ok = ok && inst.append_row == n_rows;
+            ++n_rows;
+            appended.notify_all();
+        } else {
+            std::lock_guard<std::mutex> lk(mutex);
+            ok = ok && inst.payloads[0] < n_rows;
+        }
+    }, options);
+    // Each init is followed by instructions on the user it appends
+    Instructions insts;
+    for (int row = 2; row < 42; ++row) {
+        std::string user = std::to_string(row);
+        insts.push_back(Instruction("0 " + user));
+        insts.push_back(Instruction("1 " + user + " 0 1"));
+        insts.push_back(Instruction("2 " + user + " -1 0 1"));
+        insts.push_back(Instruction("1 0 1 0"));
+    }
+    executor.run(insts);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(42, n_rows);
+}
+
+TEST(ExecutorTest, test_inits_run_concurrently) {
+    std::atomic<int> n_running(0), max_running(0);
+    Executor executor([&] (const Instruction&) {
+        int running = ++n_running;
+        int seen = max_running.load();
+        while (running > seen && !max_running.compare_exchange_weak(seen, running)) {}
+        // A cold start, only the append is ordered
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        --n_running;
+    }, small_pool(8, 0));
+    executor.run(Instructions(8, Instruction("0 1")));
+    EXPECT_GT(max_running, 1);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
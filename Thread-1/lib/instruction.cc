@@ -5,7 +5,7 @@
 
 namespace proj1 {
 
-Instruction::Instruction(std::string line) {
+Instruction::Instruction(std::string line) : append_row(-1) {
     std::stringstream ss(line);
     int data;
     ss >> data;
@@ -15,6 +15,17 @@ Instruction::Instruction(std::string line) {
     }
 }
 
+int Instruction::epoch() const {
+    switch (this->order) {
+        case UPDATE_EMB:
+            return this->payloads.size() > 3? this->payloads[3]: 0;
+        case RECOMMEND:
+            return this->payloads[1];
+        default:
+            return -1;
+    }
+}
+
 Instructions read_instructrions(std::string filename) {
     std::ifstream ifs(filename);
     std::string line;
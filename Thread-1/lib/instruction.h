@@ -14,8 +14,14 @@ enum InstructionOrder {
 
 struct Instruction {
     Instruction(std::string);
+    // The `iter_idx` of an update or recommend, -1 for an init. Updates that
+    // come without one all belong to epoch 0.
+    int epoch() const;
     InstructionOrder order;
     std::vector<int> payloads;
+    // The row an init appends at, set by an executor that orders the inits
+    // (see `EpochGate`); -1 to append at the end
+    int append_row;
 };
 
 using Instructions = std::vector<Instruction>;
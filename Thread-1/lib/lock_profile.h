@@ -0,0 +1,97 @@
+#ifndef THREAD_LIB_LOCK_PROFILE_H_
+#define THREAD_LIB_LOCK_PROFILE_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <condition_variable>
+
+namespace proj1 {
+
+struct LockStats {
+    long n_acquired;
+    long n_contended;    // acquisitions that had to wait
+    long n_failed_tries; // try_lock that found it taken
+    long wait_nsec;
+    long hold_nsec;
+};
+
+// A std::mutex that counts its acquisitions, how many of them had to wait,
+// and how long they waited for and held it. Mutexes are reported by name
+// and index, e.g. the stripe of a row lock; `report_lock_profile` prints the
+// ones waited on the most, and runs at exit once one has been created.
+class ProfiledMutex {
+public:
+    explicit ProfiledMutex(const char* name = "mutex", int index = -1);
+    ~ProfiledMutex();
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+    void set_name(const char* name, int index = -1) {
+        this->name = name;
+        this->index = index;
+    }
+    void lock() {
+        if (!this->mutex.try_lock()) {
+            long begin = now_nsec();
+            this->mutex.lock();
+            this->n_contended.fetch_add(1, std::memory_order_relaxed);
+            this->wait_nsec.fetch_add(now_nsec() - begin, std::memory_order_relaxed);
+        }
+        this->acquired();
+    }
+    bool try_lock() {
+        if (!this->mutex.try_lock()) {
+            this->n_failed_tries.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        this->acquired();
+        return true;
+    }
+    void unlock() {
+        this->hold_nsec.fetch_add(now_nsec() - this->held_since, std::memory_order_relaxed);
+        this->mutex.unlock();
+    }
+    const char* get_name() const { return this->name; }
+    int get_index() const { return this->index; }
+    LockStats get_stats() const;
+private:
+    static long now_nsec() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    void acquired() {
+        this->n_acquired.fetch_add(1, std::memory_order_relaxed);
+        this->held_since = now_nsec();  // only the holder touches it
+    }
+    std::mutex mutex;
+    const char* name;
+    int index;
+    long held_since;
+    std::atomic<long> n_acquired;
+    std::atomic<long> n_contended;
+    std::atomic<long> n_failed_tries;
+    std::atomic<long> wait_nsec;
+    std::atomic<long> hold_nsec;
+};
+
+// Prints the totals and the `top` mutexes with the most waiting
+void report_lock_profile(std::ostream& os, int top = 10);
+
+// The mutex of the instrumented locks: a ProfiledMutex when built with
+// -DPROJ1_LOCK_PROFILE, a plain std::mutex with no overhead at all otherwise.
+#ifdef PROJ1_LOCK_PROFILE
+using Mutex = ProfiledMutex;
+using ConditionVariable = std::condition_variable_any;
+inline void set_lock_name(ProfiledMutex& mutex, const char* name, int index = -1) {
+    mutex.set_name(name, index);
+}
+#else
+using Mutex = std::mutex;
+using ConditionVariable = std::condition_variable;
+inline void set_lock_name(std::mutex&, const char*, int = -1) {}
+#endif
+
+} // namespace proj1
+
+#endif // THREAD_LIB_LOCK_PROFILE_H_
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include "lock_profile.h"
+
+namespace proj1 {
+namespace testing{
+
+TEST(LockProfileTest, test_counts) {
+    ProfiledMutex mutex("test counts");
+    {
+        std::lock_guard<ProfiledMutex> lk(mutex);
+        EXPECT_FALSE(mutex.try_lock());
+    }
+    EXPECT_TRUE(mutex.try_lock());
+    mutex.unlock();
+    LockStats s = mutex.get_stats();
+    EXPECT_EQ(2, s.n_acquired);
+    EXPECT_EQ(0, s.n_contended);
+    EXPECT_EQ(1, s.n_failed_tries);
+}
+
+TEST(LockProfileTest, test_contention) {
+    ProfiledMutex mutex("test contention", 3);
+    long counter = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 200; ++i) {
+                std::lock_guard<ProfiledMutex> lk(mutex);
+                ++counter;
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        });
+    }
+    for (std::thread& t: threads) t.join();
+    LockStats s = mutex.get_stats();
+    EXPECT_EQ(800, counter);
+    EXPECT_EQ(800, s.n_acquired);
+    EXPECT_GT(s.n_contended, 0);
+    EXPECT_GT(s.wait_nsec, 0);
+    EXPECT_GE(s.hold_nsec, 800L * 20 * 1000);
+
+    std::stringstream ss;
+    report_lock_profile(ss, 1);
+    EXPECT_NE(std::string::npos, ss.str().find("test contention[3] : 800 acquired"));
+}
+
+TEST(LockProfileTest, test_condition_variable) {
+    ProfiledMutex mutex;
+    std::condition_variable_any cv;
+    bool ready = false;
+    std::thread t([&] {
+        std::lock_guard<ProfiledMutex> lk(mutex);
+        ready = true;
+        cv.notify_one();
+    });
+    {
+        std::unique_lock<ProfiledMutex> lk(mutex);
+        cv.wait(lk, [&] { return ready; });
+    }
+    t.join();
+    EXPECT_GE(mutex.get_stats().n_acquired, 2);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,19 +1,39 @@
+#include <algorithm>
 #include "model.h"
 #include "utils.h"
+#include "trace.h"
+#include "perf_counters.h"
 #include "embedding.h"
 
 namespace proj1 {
 
 const double inf = 9999999.0;
 
-double similarity(Embedding* embA, Embedding* embB) {
-    double similarity = 0;
+namespace {
+
+PerfRegion recommend_region("recommend");
+
+} // namespace
+
+double dot(Embedding* embA, Embedding* embB) {
+    double dot = 0;
     double *vecA = embA->get_data();
     double *vecB = embB->get_data();
     for (int i = 0; i < embA->get_length(); ++i) {
-        similarity += (vecA[i] - vecB[i]) * (vecA[i] - vecB[i]);
+        dot += vecA[i] * vecB[i];
     }
-    return similarity;
+    return dot;
+}
+
+double similarity(Embedding* embA, Embedding* embB, double dot) {
+    // |a - b|^2 = |a|^2 + |b|^2 - 2 a.b, with the norms kept by the rows.
+    // Rounding can take it a hair below zero for (nearly) equal rows.
+    double similarity = embA->get_squared_norm() + embB->get_squared_norm() - 2 * dot;
+    return std::max(0.0, similarity);
+}
+
+double similarity(Embedding* embA, Embedding* embB) {
+    return similarity(embA, embB, dot(embA, embB));
 }
 
 EmbeddingGradient* calc_gradient(Embedding* embA, Embedding* embB, int label) {
@@ -22,6 +42,7 @@ EmbeddingGradient* calc_gradient(Embedding* embA, Embedding* embB, int label) {
         2. a sigmoid activation function
         3. a binary cross entropy loss
     */
+    TraceScope scope("calc_gradient", "model");
     double distance = similarity(embA, embB);
     double pred = sigmoid(distance);
     double loss = binary_cross_entropy_backward((double) label, pred);
@@ -34,6 +55,7 @@ EmbeddingGradient* calc_gradient(Embedding* embA, Embedding* embB, int label) {
 }
 
 EmbeddingGradient* cold_start(Embedding* user, Embedding* item) {
+    TraceScope scope("cold_start", "model");
     // Do some downstream work, e.g. let the user watch this video
     a_slow_function(10);
     // Then we collect a label, e.g. whether the user finished watching the video
@@ -42,6 +64,7 @@ EmbeddingGradient* cold_start(Embedding* user, Embedding* item) {
 }
 
 Embedding* recommend(Embedding* user, std::vector<Embedding*> items) {
+    PerfScope perf(recommend_region);
     Embedding* maxItem;
     double sim, maxSim = -inf;
     for (auto item: items) {
@@ -54,4 +77,25 @@ Embedding* recommend(Embedding* user, std::vector<Embedding*> items) {
     return maxItem;
 }
 
+Embedding* recommend(Embedding* user, int user_idx, std::vector<Embedding*> items,
+                     const std::vector<int>& item_idxs, DotCache* cache) {
+    PerfScope perf(recommend_region);
+    Embedding* maxItem = nullptr;
+    double sim, maxSim = -inf;
+    for (unsigned int i = 0; i < items.size(); ++i) {
+        Embedding* item = items[i];
+        double d;
+        if (!cache->lookup(user_idx, user, item_idxs[i], item, &d)) {
+            d = dot(user, item);
+            cache->insert(user_idx, user, item_idxs[i], item, d);
+        }
+        sim = similarity(user, item, d);
+        if (sim > maxSim) {
+            maxItem = item;
+            maxSim = sim;
+        }
+    }
+    return maxItem;
+}
+
 } // namespace proj1
\ No newline at end of file
@@ -3,17 +3,28 @@
 
 #include <vector>
 #include "embedding.h"
+#include "dot_cache.h"
 
 namespace proj1 {
 
+double dot(Embedding* entityA, Embedding* entityB);
+
 double similarity(Embedding* entityA, Embedding* entityB);
 
+// Same as above, given the dot product of the two
+double similarity(Embedding* entityA, Embedding* entityB, double dot);
+
 EmbeddingGradient* calc_gradient(Embedding* entityA, Embedding* entityB, int label);
 
 EmbeddingGradient* cold_start(Embedding* newUser, Embedding* item);
 
 Embedding* recommend(Embedding* user, std::vector<Embedding*> items);
 
+// Same as above, reusing the dot products in `cache` of the rows (by index)
+// that did not change since they were computed
+Embedding* recommend(Embedding* user, int user_idx, std::vector<Embedding*> items,
+                     const std::vector<int>& item_idxs, DotCache* cache);
+
 } // namespace proj1
 
 #endif // THREAD_LIB_MODEL_H_
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "utils.h"
+#include "output.h"
+
+namespace proj1 {
+
+namespace {
+
+// How long an idle writer sleeps before it looks at the queue anyway, should
+// a wake-up ever be missed
+const auto kIdleRecheck = std::chrono::milliseconds(10);
+
+} // namespace
+
+OutputChannel::OutputChannel(FlushPolicy policy, std::ostream& os) :
+        policy(policy),
+        os(os),
+        n_pushed(0),
+        writer_waiting(false),
+        flush_requested(false),
+        stopping(false) {
+    Node* stub = new Node(nullptr, 0);
+    this->head.store(stub);
+    this->tail = stub;
+    memset(&this->stats, 0, sizeof(this->stats));
+    this->writer = std::thread(&OutputChannel::writer_loop, this);
+}
+
+OutputChannel::~OutputChannel() {
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->stopping.store(true);
+    }
+    this->cv.notify_all();
+    this->writer.join();
+    delete this->tail;
+}
+
+void OutputChannel::push(Embedding* result) {
+    Node* node = new Node(result, usec_since_start());
+    this->n_pushed.fetch_add(1, std::memory_order_relaxed);
+    Node* prev = this->head.exchange(node, std::memory_order_acq_rel);
+    // Sequentially consistent, as the writer's store of `writer_waiting` and
+    // load of `next`: either it sees the node, or we see it waiting
+    prev->next.store(node, std::memory_order_seq_cst);
+    if (this->writer_waiting.load(std::memory_order_seq_cst)) {
+        // Slow path, only taken when the writer went to sleep on an empty queue
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->cv.notify_one();
+    }
+}
+
+void OutputChannel::flush() {
+    long target = this->n_pushed.load();
+    std::unique_lock<std::mutex> lk(this->mutex);
+    this->flush_requested.store(true);
+    this->cv.notify_all();
+    this->flushed_cv.wait(lk, [this, target] {
+        return this->stats.n_written >= target;
+    });
+}
+
+OutputChannel::Node* OutputChannel::pop() {
+    Node* node = this->tail;
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+        return nullptr;  // empty, or a push is halfway through
+    // `next` becomes the new stub once the caller has taken its payload
+    this->tail = next;
+    delete node;
+    return next;
+}
+
+void OutputChannel::writer_loop() {
+    std::string buffer;
+    std::vector<long> pending;  // push times of the results in `buffer`
+    while (true) {
+        Node* node;
+        while ((node = this->pop()) != nullptr) {
+            buffer += "[OUTPUT]";
+            buffer += node->emb->to_string();
+            buffer += '\n';
+            delete node->emb;
+            node->emb = nullptr;
+            pending.push_back(node->pushed_usec);
+            if ((int) pending.size() >= this->policy.max_batch)
+                break;
+        }
+        long now = usec_since_start();
+        bool stop = this->stopping.load();
+        bool force = stop || this->flush_requested.exchange(false);
+        if (!pending.empty() && (force
+                || (int) pending.size() >= this->policy.max_batch
+                || now - pending.front() >= this->policy.max_delay_usec)) {
+            this->os.write(buffer.data(), buffer.size());
+            this->os.flush();
+            now = usec_since_start();
+            std::lock_guard<std::mutex> lk(this->mutex);
+            for (long pushed: pending) {
+                ++this->stats.n_written;
+                this->stats.total_delay_usec += now;
+                this->stats.max_delay_usec = now;
+                this->stats.max_queued_usec =
+                    std::max(this->stats.max_queued_usec, now - pushed);
+            }
+            buffer.clear();
+            pending.clear();
+            this->flushed_cv.notify_all();
+            continue;
+        }
+        if (stop) {
+            if (this->tail->next.load() == nullptr)
+                return;
+            continue;
+        }
+
+        // Sleep until the next push, or until the oldest pending result
+        // reaches the delay bound
+        std::unique_lock<std::mutex> lk(this->mutex);
+        // Both sequentially consistent, the mirror image of `push`
+        this->writer_waiting.store(true, std::memory_order_seq_cst);
+        if (this->tail->next.load(std::memory_order_seq_cst) == nullptr && !this->stopping.load()
+                && !this->flush_requested.load()) {
+            if (pending.empty()) {
+                this->cv.wait_for(lk, kIdleRecheck);
+            } else {
+                long deadline = pending.front() + this->policy.max_delay_usec;
+                this->cv.wait_for(lk, to_wall_time(deadline - now));
+            }
+        }
+        this->writer_waiting.store(false);
+    }
+}
+
+OutputStats OutputChannel::get_stats() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    return this->stats;
+}
+
+void OutputChannel::report() {
+    OutputStats s = this->get_stats();
+    if (s.n_written == 0)  return;
+    std::cout << "output : " << s.n_written << " results, avg delay "
+              << (long) (s.total_delay_usec / s.n_written) << " usec, max delay "
+              << s.max_delay_usec << " usec, max queued "
+              << s.max_queued_usec << " usec\n";
+}
+
+} // namespace proj1
@@ -0,0 +1,68 @@
+#ifndef THREAD_LIB_OUTPUT_H_
+#define THREAD_LIB_OUTPUT_H_
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include <condition_variable>
+#include "embedding.h"
+
+namespace proj1 {
+
+// When the writer flushes: once `max_batch` results are pending, or once the
+// oldest pending result has waited `max_delay_usec`, whichever comes first.
+// A zero delay bound writes every result as soon as it is seen.
+struct FlushPolicy {
+    FlushPolicy(): max_batch(64), max_delay_usec(1000) {}
+    int max_batch;
+    long max_delay_usec;
+};
+
+struct OutputStats {
+    long n_written;
+    long max_delay_usec;    // write time, from program start
+    double total_delay_usec;
+    long max_queued_usec;   // write time - push time
+};
+
+// Thread-safe replacement of `Embedding::write_to_stdout` for results.
+// Workers push into a lock-free multi-producer queue and never block on the
+// stream; a dedicated writer thread formats the results and writes them in
+// batches.
+class OutputChannel {
+public:
+    OutputChannel(FlushPolicy policy = FlushPolicy(), std::ostream& os = std::cout);
+    ~OutputChannel();  // writes out everything pushed before
+    void push(Embedding* result);  // takes the ownership of `result`
+    void flush();  // returns once everything pushed before is written
+    OutputStats get_stats();
+    void report();
+private:
+    struct Node {
+        Node(Embedding* e, long t): emb(e), pushed_usec(t), next(nullptr) {}
+        Embedding* emb;
+        long pushed_usec;  // since program start
+        std::atomic<Node*> next;
+    };
+    Node* pop();  // writer only
+    void writer_loop();
+
+    FlushPolicy policy;
+    std::ostream& os;
+    std::atomic<Node*> head;  // producers append here
+    Node* tail;               // the writer consumes from here
+    std::atomic<long> n_pushed;
+    std::atomic<bool> writer_waiting;
+    std::atomic<bool> flush_requested;
+    std::atomic<bool> stopping;
+    std::mutex mutex;  // only used to put the writer to sleep
+    std::condition_variable cv;
+    std::condition_variable flushed_cv;
+    OutputStats stats;
+    std::thread writer;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_OUTPUT_H_
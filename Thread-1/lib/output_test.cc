@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "output.h"
+
+namespace proj1 {
+namespace testing{
+
+int count_lines(const std::string& s) {
+    int n = 0;
+    for (char c: s) n += c == '\n';
+    return n;
+}
+
+TEST(OutputTest, test_concurrent_push) {
+    std::stringstream ss;
+    {
+        OutputChannel output(FlushPolicy(), ss);
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t) {
+            producers.emplace_back([&output] {
+                for (int i = 0; i < 1000; ++i) {
+                    output.push(new Embedding(4));
+                }
+            });
+        }
+        for (std::thread& t: producers) t.join();
+    }
+    std::string line;
+    int n = 0;
+    while (std::getline(ss, line)) {
+        EXPECT_EQ("[OUTPUT]0.000000,0.100000,0.200000,0.300000", line);
+        ++n;
+    }
+    EXPECT_EQ(4000, n);
+}
+
+TEST(OutputTest, test_latency_bound) {
+    std::stringstream ss;
+    FlushPolicy policy;
+    policy.max_batch = 1000;
+    policy.max_delay_usec = 1000;
+    OutputChannel output(policy, ss);
+    output.push(new Embedding(2));
+    // Far below the batch size, the delay bound has to flush it
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(1, output.get_stats().n_written);
+    EXPECT_LT(output.get_stats().max_queued_usec, 100 * 1000);
+}
+
+TEST(OutputTest, test_flush) {
+    std::stringstream ss;
+    FlushPolicy policy;
+    policy.max_batch = 1000;
+    policy.max_delay_usec = 3600L * 1000 * 1000;
+    OutputChannel output(policy, ss);
+    for (int i = 0; i < 5; ++i) {
+        output.push(new Embedding(2));
+    }
+    output.flush();
+    EXPECT_EQ(5, count_lines(ss.str()));
+}
+
+TEST(OutputTest, test_batch_bound) {
+    std::stringstream ss;
+    FlushPolicy policy;
+    policy.max_batch = 10;
+    policy.max_delay_usec = 3600L * 1000 * 1000;
+    OutputChannel output(policy, ss);
+    for (int i = 0; i < 25; ++i) {
+        output.push(new Embedding(2));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(20, output.get_stats().n_written);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
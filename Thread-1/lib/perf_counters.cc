@@ -0,0 +1,254 @@
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include "perf_counters.h"
+
+namespace proj1 {
+
+std::atomic<bool> perf_counting_on(false);
+
+namespace {
+
+struct EventSpec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+    bool user_only;  // context switches happen in the kernel, by definition
+};
+
+uint64_t cache_miss(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+const EventSpec kEvents[N_PERF_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, true},
+    {"L1D misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D), true},
+    {"LLC misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL), true},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, true},
+    {"context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, false},
+};
+
+std::once_flag warned;
+
+void warn_unavailable(const std::string& missing, int error) {
+    std::call_once(warned, [&] {
+        std::cerr << "perf : cannot count " << missing << " (" << strerror(error) << ")";
+        if (error == EACCES || error == EPERM)
+            std::cerr << ", see /proc/sys/kernel/perf_event_paranoid";
+        std::cerr << std::endl;
+    });
+}
+
+int open_event(const EventSpec& spec, bool inherit) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.inherit = inherit;
+    attr.exclude_kernel = spec.user_only;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Never freed, so that the report at exit can still use it
+struct Registry {
+    std::mutex mutex;
+    std::vector<PerfRegion*> regions;
+};
+
+Registry& registry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+void report_at_exit() {
+    report_perf_counters(std::cerr);
+}
+
+bool start_from_env = [] {
+    const char* value = std::getenv("PROJ1_PERF");
+    if (value == nullptr || *value == '\0' || std::string(value) == "0")
+        return false;
+    std::atexit(report_at_exit);
+    return set_perf_counting(true);
+}();
+
+} // namespace
+
+bool set_perf_counting(bool on) {
+    if (on && !PerfCounters().available())
+        on = false;
+    perf_counting_on.store(on);
+    return on;
+}
+
+PerfSample::PerfSample() : mask(0) {
+    memset(this->values, 0, sizeof(this->values));
+}
+
+double PerfSample::ipc() const {
+    if (!this->has(PERF_CYCLES) || !this->has(PERF_INSTRUCTIONS)
+            || this->values[PERF_CYCLES] == 0)
+        return -1;
+    return (double) this->values[PERF_INSTRUCTIONS] / this->values[PERF_CYCLES];
+}
+
+double PerfSample::per_kilo_instruction(PerfEvent event) const {
+    if (!this->has(event) || !this->has(PERF_INSTRUCTIONS)
+            || this->values[PERF_INSTRUCTIONS] == 0)
+        return -1;
+    return 1000.0 * this->values[event] / this->values[PERF_INSTRUCTIONS];
+}
+
+PerfSample& PerfSample::operator+=(const PerfSample& other) {
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        this->values[e] += other.values[e];
+    }
+    this->mask |= other.mask;
+    return *this;
+}
+
+PerfSample PerfSample::operator-(const PerfSample& other) const {
+    PerfSample diff = *this;
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        diff.values[e] -= other.values[e];
+    }
+    diff.mask &= other.mask;
+    return diff;
+}
+
+std::string format_perf_sample(const PerfSample& sample) {
+    std::stringstream ss;
+    ss.precision(3);
+    std::string sep;
+    if (sample.ipc() >= 0) {
+        ss << sample.ipc() << " IPC";
+        sep = ", ";
+    }
+    std::string misses;
+    for (PerfEvent e: {PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES}) {
+        if (sample.per_kilo_instruction(e) < 0)
+            continue;
+        ss << (misses.empty()? sep: std::string(" / ")) << sample.per_kilo_instruction(e);
+        // "L1D misses" -> "L1D"
+        misses = kEvents[e].name;
+        ss << " " << misses.substr(0, misses.find(" misses"));
+    }
+    if (!misses.empty()) {
+        ss << " misses per 1k instructions";
+        sep = ", ";
+    }
+    if (sample.has(PERF_CONTEXT_SWITCHES))
+        ss << sep << sample.values[PERF_CONTEXT_SWITCHES] << " context switches";
+    return ss.str();
+}
+
+PerfCounters::PerfCounters(bool inherit) {
+    std::string missing;
+    int error = 0;
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        this->fds[e] = open_event(kEvents[e], inherit);
+        if (this->fds[e] < 0) {
+            missing += (missing.empty()? "": ", ") + std::string(kEvents[e].name);
+            error = errno;
+        }
+    }
+    if (!missing.empty())
+        warn_unavailable(missing, error);
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd: this->fds) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+bool PerfCounters::available() const {
+    for (int fd: this->fds) {
+        if (fd >= 0)
+            return true;
+    }
+    return false;
+}
+
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        uint64_t buf[3];  // value, time enabled, time running
+        if (this->fds[e] < 0 || ::read(this->fds[e], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+        if (buf[2] > 0 && buf[2] < buf[1])
+            buf[0] = (uint64_t) ((double) buf[0] * buf[1] / buf[2]);
+        sample.values[e] = buf[0];
+        sample.mask |= 1u << e;
+    }
+    return sample;
+}
+
+PerfRegion::PerfRegion(const char* name) : name(name), n_scopes(0), mask(0) {
+    for (std::atomic<long>& value: this->values) {
+        value.store(0);
+    }
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mutex);
+    r.regions.push_back(this);
+}
+
+void PerfRegion::add(const PerfSample& sample) {
+    this->n_scopes.fetch_add(1, std::memory_order_relaxed);
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        this->values[e].fetch_add(sample.values[e], std::memory_order_relaxed);
+    }
+    this->mask.fetch_or(sample.mask, std::memory_order_relaxed);
+}
+
+PerfSample PerfRegion::get_total() const {
+    PerfSample total;
+    for (int e = 0; e < N_PERF_EVENTS; ++e) {
+        total.values[e] = this->values[e].load();
+    }
+    total.mask = this->mask.load();
+    return total;
+}
+
+namespace {
+
+PerfCounters& thread_counters() {
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+} // namespace
+
+void PerfScope::begin() {
+    this->start = thread_counters().read();
+}
+
+void PerfScope::finish() {
+    this->region.add(thread_counters().read() - this->start);
+}
+
+void report_perf_counters(std::ostream& os) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mutex);
+    for (PerfRegion* region: r.regions) {
+        if (region->get_n_scopes() == 0)
+            continue;
+        os << "perf : " << region->get_name() << " " << region->get_n_scopes()
+           << " scopes, " << format_perf_sample(region->get_total()) << "\n";
+    }
+}
+
+} // namespace proj1
@@ -0,0 +1,114 @@
+#ifndef THREAD_LIB_PERF_COUNTERS_H_
+#define THREAD_LIB_PERF_COUNTERS_H_
+
+#include <atomic>
+#include <string>
+#include <ostream>
+
+namespace proj1 {
+
+// Hardware performance counters through perf_event_open(2), counting user
+// space only so that they work with the default perf_event_paranoid.
+//
+// Counting is off unless `set_perf_counting(true)` is called, or
+// `PROJ1_PERF` is set in the environment; off, a scope costs one relaxed
+// load. Events the kernel or the cpu do not provide (containers, VMs,
+// paranoid settings) are left out of the reports, with one warning; if none
+// can be opened, counting stays off.
+
+enum PerfEvent {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,      // L1 data cache read misses
+    PERF_LLC_MISSES,      // last level cache read misses
+    PERF_BRANCH_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    N_PERF_EVENTS
+};
+
+extern std::atomic<bool> perf_counting_on;
+
+inline bool perf_counting() {
+    return perf_counting_on.load(std::memory_order_relaxed);
+}
+
+// Returns whether counting is on, i.e. false when turning it on failed
+bool set_perf_counting(bool on);
+
+struct PerfSample {
+    PerfSample();
+    bool has(PerfEvent event) const { return this->mask & (1u << event); }
+    double ipc() const;  // instructions per cycle, -1 when not counted
+    double per_kilo_instruction(PerfEvent event) const;  // -1 when not counted
+    PerfSample& operator+=(const PerfSample& other);
+    PerfSample operator-(const PerfSample& other) const;
+    long values[N_PERF_EVENTS];
+    unsigned int mask;  // of the events counted
+};
+
+// "1.52 IPC, 4.1 L1D / 0.3 LLC / 2.2 branch misses per 1k instructions,
+// 15 context switches", with only what was counted
+std::string format_perf_sample(const PerfSample& sample);
+
+// The counters of the calling thread, from construction on. With `inherit`
+// they also count the threads it starts afterwards, e.g. executor workers.
+// Reading costs a syscall per event.
+class PerfCounters {
+public:
+    explicit PerfCounters(bool inherit = false);
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    bool available() const;  // some event could be opened
+    PerfSample read() const;  // scaled up when the kernel multiplexed them
+private:
+    int fds[N_PERF_EVENTS];
+};
+
+// Counts summed over every `PerfScope` of a region, from any thread.
+// Regions are registered for good, so give them static storage, e.g. at
+// namespace scope. They are reported at exit when counting was turned on
+// from the environment.
+class PerfRegion {
+public:
+    explicit PerfRegion(const char* name);
+    PerfRegion(const PerfRegion&) = delete;
+    PerfRegion& operator=(const PerfRegion&) = delete;
+    void add(const PerfSample& sample);
+    long get_n_scopes() const { return this->n_scopes.load(); }
+    PerfSample get_total() const;
+    const char* get_name() const { return this->name; }
+private:
+    const char* name;
+    std::atomic<long> n_scopes;
+    std::atomic<long> values[N_PERF_EVENTS];
+    std::atomic<unsigned int> mask;
+};
+
+// Adds the counts of the calling thread, from construction to destruction,
+// to `region`. Each thread opens its counters on its first scope.
+class PerfScope {
+public:
+    explicit PerfScope(PerfRegion& region) : region(region) {
+        this->active = perf_counting();
+        if (this->active)
+            this->begin();
+    }
+    ~PerfScope() {
+        if (this->active)
+            this->finish();
+    }
+private:
+    void begin();
+    void finish();
+    PerfRegion& region;
+    bool active;
+    PerfSample start;
+};
+
+// One line per region that ran
+void report_perf_counters(std::ostream& os);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_PERF_COUNTERS_H_
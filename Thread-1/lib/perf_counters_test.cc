@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "perf_counters.h"
+
+namespace proj1 {
+namespace testing{
+
+PerfRegion test_region("test");
+
+double busy_loop(int n) {
+    volatile double x = 0;
+    for (int i = 0; i < n; ++i) {
+        x = x + i * 0.5;
+    }
+    return x;
+}
+
+TEST(PerfCountersTest, test_format) {
+    PerfSample sample;
+    EXPECT_EQ("", format_perf_sample(sample));
+    EXPECT_EQ(-1, sample.ipc());
+
+    sample.values[PERF_CYCLES] = 1000;
+    sample.values[PERF_INSTRUCTIONS] = 2000;
+    sample.values[PERF_LLC_MISSES] = 4;
+    sample.values[PERF_CONTEXT_SWITCHES] = 3;
+    sample.mask = (1u << PERF_CYCLES) | (1u << PERF_INSTRUCTIONS)
+        | (1u << PERF_LLC_MISSES) | (1u << PERF_CONTEXT_SWITCHES);
+    EXPECT_DOUBLE_EQ(2.0, sample.ipc());
+    EXPECT_DOUBLE_EQ(2.0, sample.per_kilo_instruction(PERF_LLC_MISSES));
+    EXPECT_EQ(-1, sample.per_kilo_instruction(PERF_L1D_MISSES));
+    EXPECT_EQ("2 IPC, 2 LLC misses per 1k instructions, 3 context switches",
+              format_perf_sample(sample));
+
+    PerfSample diff = sample - PerfSample();
+    EXPECT_EQ(0u, diff.mask);  // nothing was counted in the other one
+    diff = sample;
+    diff += sample;
+    EXPECT_EQ(4000, diff.values[PERF_INSTRUCTIONS]);
+    EXPECT_EQ(sample.mask, diff.mask);
+}
+
+// Only checks what it can where perf events are not permitted
+TEST(PerfCountersTest, test_counters) {
+    PerfCounters counters;
+    PerfSample begin = counters.read();
+    busy_loop(1000000);
+    PerfSample used = counters.read() - begin;
+    if (!counters.available()) {
+        EXPECT_EQ(0u, used.mask);
+        return;
+    }
+    EXPECT_NE(0u, used.mask);
+    if (used.has(PERF_INSTRUCTIONS)) {
+        EXPECT_GT(used.values[PERF_INSTRUCTIONS], 1000000);
+    }
+}
+
+TEST(PerfCountersTest, test_scope) {
+    bool on = set_perf_counting(true);
+    {
+        PerfScope scope(test_region);
+        busy_loop(1000);
+    }
+    EXPECT_EQ(on? 1: 0, test_region.get_n_scopes());
+    set_perf_counting(false);
+    {
+        PerfScope scope(test_region);
+    }
+    EXPECT_EQ(on? 1: 0, test_region.get_n_scopes());
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,163 @@
+#ifndef THREAD_LIB_RCU_H_
+#define THREAD_LIB_RCU_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace proj1 {
+
+// A pointer that readers follow without ever blocking, and that a writer can
+// replace at any time (read-copy-update). A reader pins the current version
+// with a `Guard`; `swap` publishes a new version immediately, and the old one
+// is deleted by a background reclaimer once the last reader that could have
+// seen it has left. Neither side waits for the other.
+//
+// Readers register in one of two reader counts, picked by the parity of a
+// grace-period counter. The reclaimer flips the parity and waits for the old
+// count to drain. The counts are striped by thread to keep readers of
+// different cores off each other's cache lines.
+template <class T>
+class RcuCell {
+public:
+    class Guard {
+    public:
+        Guard(Guard&& other): counter(other.counter), value(other.value) {
+            other.counter = nullptr;
+        }
+        ~Guard() { if (this->counter != nullptr) this->counter->fetch_sub(1); }
+        T* get() const { return this->value; }
+        T* operator->() const { return this->value; }
+        T& operator*() const { return *this->value; }
+    private:
+        friend class RcuCell;
+        Guard(std::atomic<long>* counter, T* value): counter(counter), value(value) {}
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        std::atomic<long>* counter;
+        T* value;
+    };
+
+    explicit RcuCell(T* initial);
+    ~RcuCell();  // readers must be gone by then
+    Guard read();
+    void swap(T* next);  // takes the ownership of `next`
+    long get_n_reclaimed() { return this->n_reclaimed.load(); }
+
+private:
+    static const int kStripes = 16;
+    static const int kCacheLine = 64;
+    // A whole line of padding keeps the counts of two stripes off a common
+    // cache line wherever the cell lives: C++11 `new` does not honor an
+    // alignment beyond the default, so the cell may not start on a line
+    struct Stripe {
+        std::atomic<long> readers[2];
+        char padding[kCacheLine];
+    };
+    long count_readers(unsigned parity);
+    void reclaimer_loop();
+
+    std::atomic<T*> current;
+    std::atomic<unsigned> grace_period;
+    Stripe stripes[kStripes];
+    std::mutex mutex;  // guards `retired` and `stopping`
+    std::condition_variable cv;
+    std::vector<T*> retired;
+    bool stopping;
+    std::atomic<long> n_reclaimed;
+    std::thread reclaimer;
+};
+
+template <class T>
+RcuCell<T>::RcuCell(T* initial) :
+        current(initial),
+        grace_period(0),
+        stopping(false),
+        n_reclaimed(0) {
+    for (Stripe& s: this->stripes) {
+        s.readers[0].store(0);
+        s.readers[1].store(0);
+    }
+    this->reclaimer = std::thread(&RcuCell::reclaimer_loop, this);
+}
+
+template <class T>
+RcuCell<T>::~RcuCell() {
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->stopping = true;
+    }
+    this->cv.notify_all();
+    this->reclaimer.join();
+    delete this->current.load();
+}
+
+template <class T>
+typename RcuCell<T>::Guard RcuCell<T>::read() {
+    static thread_local size_t stripe =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % kStripes;
+    Stripe& s = this->stripes[stripe];
+    while (true) {
+        unsigned gp = this->grace_period.load();
+        std::atomic<long>& counter = s.readers[gp & 1];
+        counter.fetch_add(1);
+        // If the parity flipped meanwhile, the reclaimer may not wait for us
+        if (this->grace_period.load() == gp)
+            return Guard(&counter, this->current.load());
+        counter.fetch_sub(1);
+    }
+}
+
+template <class T>
+void RcuCell<T>::swap(T* next) {
+    T* old = this->current.exchange(next);
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->retired.push_back(old);
+    }
+    this->cv.notify_one();
+}
+
+template <class T>
+long RcuCell<T>::count_readers(unsigned parity) {
+    long n = 0;
+    for (Stripe& s: this->stripes) {
+        n += s.readers[parity].load();
+    }
+    return n;
+}
+
+template <class T>
+void RcuCell<T>::reclaimer_loop() {
+    std::unique_lock<std::mutex> lk(this->mutex);
+    while (true) {
+        this->cv.wait(lk, [this] { return this->stopping || !this->retired.empty(); });
+        std::vector<T*> batch;
+        batch.swap(this->retired);
+        bool stop = this->stopping;
+        lk.unlock();
+
+        // Everything in `batch` was unpublished before this flip, so only
+        // readers of the old parity can still hold it
+        unsigned old_parity = this->grace_period.fetch_add(1) & 1;
+        while (this->count_readers(old_parity) != 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        for (T* value: batch) {
+            delete value;
+        }
+        this->n_reclaimed.fetch_add(batch.size());
+
+        lk.lock();
+        if (stop && this->retired.empty())
+            return;
+    }
+}
+
+} // namespace proj1
+
+#endif // THREAD_LIB_RCU_H_
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "rcu.h"
+
+namespace proj1 {
+namespace testing{
+
+struct Version {
+    Version(int v, std::atomic<int>* n_alive): value(v), n_alive(n_alive) { ++*n_alive; }
+    ~Version() { --*n_alive; }
+    int value;
+    std::atomic<int>* n_alive;
+};
+
+TEST(RcuTest, test_old_version_outlives_reader) {
+    std::atomic<int> n_alive(0);
+    RcuCell<Version> cell(new Version(1, &n_alive));
+    {
+        RcuCell<Version>::Guard reader = cell.read();
+        cell.swap(new Version(2, &n_alive));
+        EXPECT_EQ(2, cell.read()->value);  // new readers see the new version
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_EQ(1, reader->value);       // the pinned one is still alive
+        EXPECT_EQ(2, n_alive.load());
+    }
+    while (cell.get_n_reclaimed() < 1) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(1, n_alive.load());
+}
+
+TEST(RcuTest, test_concurrent_swaps) {
+    std::atomic<int> n_alive(0);
+    std::atomic<bool> done(false);
+    std::atomic<bool> ok(true);
+    {
+        RcuCell<Version> cell(new Version(0, &n_alive));
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done.load()) {
+                    RcuCell<Version>::Guard v = cell.read();
+                    // Versions only move forward, and are never freed under us
+                    if (v->value < last || v->n_alive != &n_alive)  ok = false;
+                    last = v->value;
+                }
+            });
+        }
+        for (int i = 1; i <= 1000; ++i) {
+            cell.swap(new Version(i, &n_alive));
+        }
+        done = true;
+        for (std::thread& t: readers) t.join();
+    }
+    EXPECT_TRUE(ok.load());
+    EXPECT_EQ(0, n_alive.load());
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include "recommend_cache.h"
+
+namespace proj1 {
+
+RecommendCache::RecommendCache(size_t budget_bytes) :
+        shard_budget(budget_bytes / kShards),
+        n_hits(0),
+        n_misses(0),
+        n_stale(0),
+        n_evictions(0) {}
+
+RecommendCache::Key RecommendCache::make_key(int user_idx, const std::vector<int>& pool) {
+    unsigned long hash = 14695981039346656037ul;  // FNV-1a over the indices
+    for (int idx: pool) {
+        hash ^= (unsigned int) idx;
+        hash *= 1099511628211ul;
+    }
+    return Key{user_idx, hash};
+}
+
+RecommendCache::Shard& RecommendCache::shard_of(const Key& key) {
+    return this->shards[KeyHash()(key) % kShards];
+}
+
+int RecommendCache::lookup(int user_idx, const std::vector<int>& pool,
+                           const std::vector<unsigned long>& versions) {
+    Key key = make_key(user_idx, pool);
+    Shard& shard = this->shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end() || found->second->pool != pool) {
+        this->n_misses.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+    if (found->second->versions != versions) {
+        this->n_misses.fetch_add(1, std::memory_order_relaxed);
+        this->n_stale.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    this->n_hits.fetch_add(1, std::memory_order_relaxed);
+    return found->second->winner;
+}
+
+void RecommendCache::insert(int user_idx, const std::vector<int>& pool,
+                            const std::vector<unsigned long>& versions, int winner) {
+    Key key = make_key(user_idx, pool);
+    size_t n_bytes = sizeof(Entry) + pool.size() * sizeof(int) +
+        versions.size() * sizeof(unsigned long);
+    if (n_bytes > this->shard_budget)
+        return;
+    Shard& shard = this->shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        shard.n_bytes -= found->second->n_bytes;
+        shard.lru.erase(found->second);
+        shard.index.erase(found);
+    }
+    while (!shard.lru.empty() && shard.n_bytes + n_bytes > this->shard_budget) {
+        shard.n_bytes -= shard.lru.back().n_bytes;
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+        this->n_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.lru.push_front(Entry{key, pool, versions, winner, n_bytes});
+    shard.index[key] = shard.lru.begin();
+    shard.n_bytes += n_bytes;
+}
+
+RecommendCacheStats RecommendCache::get_stats() {
+    RecommendCacheStats stats;
+    stats.n_hits = this->n_hits.load();
+    stats.n_misses = this->n_misses.load();
+    stats.n_stale = this->n_stale.load();
+    stats.n_evictions = this->n_evictions.load();
+    stats.n_bytes = 0;
+    for (Shard& shard: this->shards) {
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        stats.n_bytes += shard.n_bytes;
+    }
+    return stats;
+}
+
+double RecommendCache::hit_rate() {
+    RecommendCacheStats s = this->get_stats();
+    long n = s.n_hits + s.n_misses;
+    return n == 0? 0.0: (double) s.n_hits / n;
+}
+
+void RecommendCache::report() {
+    RecommendCacheStats s = this->get_stats();
+    std::cout << "recommend cache : " << s.n_hits << " hits, " << s.n_misses
+              << " misses (" << s.n_stale << " stale), " << s.n_evictions
+              << " evicted, " << s.n_bytes << " bytes (" << this->hit_rate() * 100
+              << "% hit)\n";
+}
+
+} // namespace proj1
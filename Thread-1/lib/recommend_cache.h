@@ -0,0 +1,84 @@
+#ifndef THREAD_LIB_RECOMMEND_CACHE_H_
+#define THREAD_LIB_RECOMMEND_CACHE_H_
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+
+namespace proj1 {
+
+struct RecommendCacheStats {
+    long n_hits;
+    long n_misses;
+    long n_stale;      // misses on an entry whose rows were updated since
+    long n_evictions;  // entries dropped to stay within the budget
+    size_t n_bytes;
+};
+
+// A concurrent cache of recommend results, keyed by the user index and the
+// item pool (by index, in order).
+//
+// An entry remembers the version of the user row and of every row in the
+// pool it was computed from, given as `versions` (the user first, then the
+// items). A lookup only hits if all of them are still the same, so an
+// update of any of those rows invalidates the result. The entries are split
+// over shards with their own lock and LRU list, each shard evicts its least
+// recently used entries to stay within its part of `budget_bytes`.
+//
+// NOTE: versions are per holder, a cache must only be used with the same
+// user and item holders.
+class RecommendCache {
+public:
+    explicit RecommendCache(size_t budget_bytes = 64 << 20);
+    // Returns the position in `pool` of the recommended item, or -1
+    int lookup(int user_idx, const std::vector<int>& pool,
+               const std::vector<unsigned long>& versions);
+    void insert(int user_idx, const std::vector<int>& pool,
+                const std::vector<unsigned long>& versions, int winner);
+    RecommendCacheStats get_stats();
+    double hit_rate();
+    void report();
+private:
+    struct Key {
+        int user_idx;
+        unsigned long pool_hash;
+        bool operator==(const Key& other) const {
+            return user_idx == other.user_idx && pool_hash == other.pool_hash;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return key.pool_hash ^ ((unsigned long) key.user_idx * 0x9e3779b97f4a7c15ul);
+        }
+    };
+    struct Entry {
+        Key key;
+        std::vector<int> pool;
+        std::vector<unsigned long> versions;
+        int winner;
+        size_t n_bytes;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;  // most recently used first
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t n_bytes = 0;
+    };
+    static const int kShards = 16;
+
+    static Key make_key(int user_idx, const std::vector<int>& pool);
+    Shard& shard_of(const Key& key);
+
+    size_t shard_budget;
+    Shard shards[kShards];
+    std::atomic<long> n_hits;
+    std::atomic<long> n_misses;
+    std::atomic<long> n_stale;
+    std::atomic<long> n_evictions;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_RECOMMEND_CACHE_H_
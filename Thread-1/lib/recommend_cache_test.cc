@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include "runner.h"
+#include "recommend_cache.h"
+
+namespace proj1 {
+namespace testing{
+
+TEST(RecommendCacheTest, test_hit_only_on_same_versions) {
+    RecommendCache cache;
+    std::vector<int> pool = {4, 2, 7};
+    cache.insert(1, pool, {3, 0, 5, 1}, 2);
+    EXPECT_EQ(2, cache.lookup(1, pool, {3, 0, 5, 1}));
+    EXPECT_EQ(-1, cache.lookup(1, pool, {3, 0, 6, 1}));  // item 2 updated
+    EXPECT_EQ(-1, cache.lookup(1, pool, {4, 0, 5, 1}));  // user updated
+    EXPECT_EQ(-1, cache.lookup(1, {4, 7, 2}, {3, 0, 1, 5}));
+    EXPECT_EQ(-1, cache.lookup(0, pool, {3, 0, 5, 1}));
+    RecommendCacheStats stats = cache.get_stats();
+    EXPECT_EQ(1, stats.n_hits);
+    EXPECT_EQ(4, stats.n_misses);
+    EXPECT_EQ(2, stats.n_stale);
+}
+
+TEST(RecommendCacheTest, test_budget) {
+    RecommendCache cache(16 * 1024);
+    std::vector<int> pool(10, 0);
+    std::vector<unsigned long> versions(11, 0);
+    for (int user = 0; user < 1000; ++user) {
+        cache.insert(user, pool, versions, 0);
+    }
+    RecommendCacheStats stats = cache.get_stats();
+    EXPECT_LE(stats.n_bytes, 16u * 1024);
+    EXPECT_GT(stats.n_evictions, 0);
+    // The most recent one is kept
+    EXPECT_EQ(0, cache.lookup(999, pool, versions));
+}
+
+EmbeddingHolder* make_holder(int n_rows) {
+    EmbeddingMatrix matrix;
+    for (int i = 0; i < n_rows; ++i) {
+        double* data = new double[8];
+        for (int j = 0; j < 8; ++j) data[j] = std::sin(i * 8 + j);
+        matrix.push_back(new Embedding(8, data));
+    }
+    return new EmbeddingHolder(matrix);
+}
+
+TEST(RecommendCacheTest, test_runner_same_as_uncached) {
+    EmbeddingHolder* users = make_holder(4);
+    EmbeddingHolder* items = make_holder(16);
+    RecommendCache cache;
+    Instruction rec("2 1 0 3 5 8 9 12 15");
+    int moved[] = {3, 8, 15, 5};
+    for (int round = 0; round < 4; ++round) {
+        std::string expected = reply_instruction(rec, users, items);
+        EXPECT_EQ(expected, reply_instruction(rec, users, items, &cache));
+        EXPECT_EQ(expected, reply_instruction(rec, users, items, &cache));
+        // Moves one of the pool items, the next round has to recompute
+        reply_instruction(Instruction("1 2 " + std::to_string(moved[round]) + " 1"), users, items);
+    }
+    RecommendCacheStats stats = cache.get_stats();
+    EXPECT_EQ(4, stats.n_hits);
+    EXPECT_EQ(3, stats.n_stale);
+    delete users;
+    delete items;
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,201 @@
+#include <mutex>
+#include <vector>
+
+#include "model.h"
+#include "trace.h"
+#include "runner.h"
+#include "transaction.h"
+
+namespace proj1 {
+
+namespace {
+
+std::mutex output_mutex;  // Embedding::write_to_stdout is not thread-safe
+
+const char* kOrderNames[] = {"init", "update", "recommend"};
+
+// Tags the span of an instruction with its rows and epoch
+void trace_args(TraceScope& scope, const Instruction& inst) {
+    if (!tracing())
+        return;
+    if (inst.order != INIT_EMB)
+        scope.arg("user", inst.payloads[0]);
+    if (inst.order == UPDATE_EMB)
+        scope.arg("item", inst.payloads[1]);
+    scope.arg("epoch", inst.epoch());
+}
+
+Embedding* snapshot(EmbeddingHolder* holder, int idx) {
+    Embedding* row = holder->get_embedding(idx);
+    std::lock_guard<Mutex> lk(holder->row_lock(idx));
+    return new Embedding(row);
+}
+
+int run_init(const Instruction& inst,
+             EmbeddingHolder* users, EmbeddingHolder* items) {
+    // The new user stays private until all cold starts are done
+    Embedding* new_user = new Embedding(users->get_emb_length());
+    for (int item_index: inst.payloads) {
+        Embedding* item = snapshot(items, item_index);
+        EmbeddingGradient* gradient = cold_start(new_user, item);
+        new_user->update(gradient, 0.01);
+        delete gradient;
+        delete item;
+    }
+    if (inst.append_row >= 0)
+        return users->append_at(inst.append_row, new_user);
+    return users->append(new_user);
+}
+
+// Conflicts an update tolerates before it computes under the row locks
+const int kMaxOptimisticUpdates = 3;
+
+void run_update(const Instruction& inst,
+                EmbeddingHolder* users, EmbeddingHolder* items) {
+    int user_idx = inst.payloads[0];
+    int item_idx = inst.payloads[1];
+    int label = inst.payloads[2];
+    RowTransaction txn;
+    txn.add(users, user_idx).add(items, item_idx);
+    for (int attempt = 0; attempt < kMaxOptimisticUpdates; ++attempt) {
+        // The gradients are computed unlocked, from copies of both rows
+        txn.lock();
+        Embedding* user = new Embedding(users->get_embedding(user_idx));
+        Embedding* item = new Embedding(items->get_embedding(item_idx));
+        unsigned long user_version = user->get_version();
+        unsigned long item_version = item->get_version();
+        txn.unlock();
+        // Same data flow as q0: the item gradient sees the updated user
+        EmbeddingGradient* user_gradient = calc_gradient(user, item, label);
+        user->update(user_gradient, 0.01);
+        EmbeddingGradient* item_gradient = calc_gradient(item, user, label);
+        // Published only if neither row changed since it was copied, so the
+        // pair update is serializable with every other one
+        txn.lock();
+        bool current = users->get_embedding(user_idx)->get_version() == user_version &&
+            items->get_embedding(item_idx)->get_version() == item_version;
+        if (current) {
+            users->update_embedding(user_idx, user_gradient, 0.01);
+            items->update_embedding(item_idx, item_gradient, 0.001);
+        }
+        txn.unlock();
+        delete user_gradient;
+        delete item_gradient;
+        delete user;
+        delete item;
+        if (current)
+            return;
+    }
+    // A hot pair: holding the locks is cheaper than computing it again
+    update_pair(users, user_idx, items, item_idx, label);
+}
+
+unsigned long row_version(EmbeddingHolder* holder, int idx) {
+    Embedding* row = holder->get_embedding(idx);
+    std::lock_guard<Mutex> lk(holder->row_lock(idx));
+    return row->get_version();
+}
+
+// Returns a snapshot of the recommended item, owned by the caller
+Embedding* run_recommend(const Instruction& inst,
+                         EmbeddingHolder* users, EmbeddingHolder* items,
+                         DotCache* dots = nullptr, RecommendCache* results = nullptr) {
+    int user_idx = inst.payloads[0];
+    std::vector<int> item_idxs(inst.payloads.begin() + 2, inst.payloads.end());
+    if (results != nullptr) {
+        // Reading the versions is much cheaper than copying the rows
+        std::vector<unsigned long> versions(1, row_version(users, user_idx));
+        for (int item_idx: item_idxs) {
+            versions.push_back(row_version(items, item_idx));
+        }
+        int winner = results->lookup(user_idx, item_idxs, versions);
+        if (winner >= 0) {
+            Embedding* recommendation = snapshot(items, item_idxs[winner]);
+            if (recommendation->get_version() == versions[winner + 1])
+                return recommendation;
+            delete recommendation;  // updated in the meantime, recompute
+        }
+    }
+
+    Embedding* user = snapshot(users, user_idx);
+    std::vector<Embedding*> item_pool;
+    for (unsigned int i = 2; i < inst.payloads.size(); ++i) {
+        item_pool.push_back(snapshot(items, inst.payloads[i]));
+    }
+    // Snapshots keep the version of their row, so they can share the caches
+    Embedding* recommendation = dots == nullptr? recommend(user, item_pool):
+        recommend(user, user_idx, item_pool, item_idxs, dots);
+    if (results != nullptr) {
+        std::vector<unsigned long> versions(1, user->get_version());
+        int winner = 0;
+        for (unsigned int i = 0; i < item_pool.size(); ++i) {
+            versions.push_back(item_pool[i]->get_version());
+            if (item_pool[i] == recommendation)
+                winner = i;
+        }
+        results->insert(user_idx, item_idxs, versions, winner);
+    }
+    for (Embedding* item: item_pool) {
+        if (item != recommendation)
+            delete item;
+    }
+    delete user;
+    return recommendation;
+}
+
+} // namespace
+
+void run_instruction(const Instruction& inst,
+                     EmbeddingHolder* users, EmbeddingHolder* items,
+                     OutputChannel* output, DotCache* dots,
+                     RecommendCache* results) {
+    TraceScope scope(kOrderNames[inst.order], "instruction",
+                     &instruction_histogram(inst.order));
+    trace_args(scope, inst);
+    switch(inst.order) {
+        case INIT_EMB:
+            run_init(inst, users, items);
+            break;
+        case UPDATE_EMB:
+            run_update(inst, users, items);
+            break;
+        case RECOMMEND: {
+            Embedding* recommendation = run_recommend(inst, users, items, dots, results);
+            if (output != nullptr) {
+                // The channel owns the snapshot from now on
+                output->push(recommendation);
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lk(output_mutex);
+                recommendation->write_to_stdout();
+            }
+            delete recommendation;
+            break;
+        }
+    }
+}
+
+std::string reply_instruction(const Instruction& inst,
+                              EmbeddingHolder* users, EmbeddingHolder* items,
+                              RecommendCache* results) {
+    TraceScope scope(kOrderNames[inst.order], "instruction",
+                     &instruction_histogram(inst.order));
+    trace_args(scope, inst);
+    switch(inst.order) {
+        case INIT_EMB:
+            return "OK " + std::to_string(run_init(inst, users, items));
+        case UPDATE_EMB:
+            run_update(inst, users, items);
+            return "OK";
+        case RECOMMEND: {
+            Embedding* recommendation = run_recommend(inst, users, items, nullptr, results);
+            std::string reply = "[OUTPUT]" + recommendation->to_string();
+            delete recommendation;
+            return reply;
+        }
+    }
+    return "ERR unknown order";
+}
+
+} // namespace proj1
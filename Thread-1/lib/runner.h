@@ -0,0 +1,33 @@
+#ifndef THREAD_LIB_RUNNER_H_
+#define THREAD_LIB_RUNNER_H_
+
+#include <string>
+#include "embedding.h"
+#include "output.h"
+#include "dot_cache.h"
+#include "recommend_cache.h"
+#include "instruction.h"
+
+namespace proj1 {
+
+// Thread-safe version of `run_one_instruction` in q0.cc. The slow model calls
+// work on private copies of the rows, so a row lock is only held to take a
+// snapshot or to apply a gradient, never across `a_slow_function`. Recommend
+// results go to `output` when given, or else to stdout under a global lock.
+// Recommends reuse the unchanged dot products in `dots` when given, and the
+// whole result from `results` when none of their rows changed since.
+void run_instruction(const Instruction& inst,
+                     EmbeddingHolder* users, EmbeddingHolder* items,
+                     OutputChannel* output = nullptr, DotCache* dots = nullptr,
+                     RecommendCache* results = nullptr);
+
+// Same as `run_instruction`, but returns the result as a reply line of the
+// server protocol: "OK <new user index>" for an init, "OK" for an update and
+// the `[OUTPUT]` line for a recommend.
+std::string reply_instruction(const Instruction& inst,
+                              EmbeddingHolder* users, EmbeddingHolder* items,
+                              RecommendCache* results = nullptr);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_RUNNER_H_
@@ -0,0 +1,320 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "runner.h"
+#include "server.h"
+
+namespace proj1 {
+
+namespace {
+
+const int kMaxEvents = 64;
+const int kReadChunk = 64 * 1024;
+const long kMaxInFlight = 4096;  // per connection, stop reading beyond it
+
+// Every request is checked against the tables it runs on, and an init
+// replies with the row it got, so the executor need not order the inits
+ExecutorOptions untracked_rows(ExecutorOptions options) {
+    options.first_new_row = -1;
+    return options;
+}
+
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+} // namespace
+
+struct Server::Connection {
+    Connection(int fd): fd(fd), next_seq(0), next_reply(0), events(0),
+        read_closed(false) {}
+    int fd;            // -1 once closed
+    std::string in;    // bytes read, not yet a full line
+    std::string out;   // replies not yet written
+    long next_seq;     // sequence number of the next request
+    long next_reply;   // sequence number of the next reply to send
+    uint32_t events;   // what epoll currently waits for
+    bool read_closed;  // the client sent all its requests
+    std::mutex mutex;  // guards `replies`, which workers fill in
+    std::map<long, std::string> replies;
+};
+
+ServingTables::~ServingTables() {
+    delete this->users;
+    delete this->items;
+    for (SharedTable* table: this->tables) {
+        delete table;
+    }
+}
+
+Server::Server(std::string socket_path, ServingTables* tables,
+               ExecutorOptions options) :
+        socket_path(std::move(socket_path)),
+        tables(tables),
+        stopping(false),
+        executor([] (const Instruction&) {}, untracked_rows(options)) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (this->socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path too long: " + this->socket_path);
+    strcpy(addr.sun_path, this->socket_path.c_str());
+    unlink(addr.sun_path);
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listen_fd < 0
+            || bind(this->listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0
+            || listen(this->listen_fd, SOMAXCONN) < 0)
+        throw std::runtime_error("Error listening on " + this->socket_path + "!");
+    set_nonblocking(this->listen_fd);
+    this->event_fd = eventfd(0, EFD_NONBLOCK);
+    this->epoll_fd = epoll_create1(0);
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = this->listen_fd;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->listen_fd, &ev);
+    ev.data.fd = this->event_fd;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->event_fd, &ev);
+}
+
+Server::~Server() {
+    // Workers still report back through the eventfd
+    this->executor.wait();
+    for (auto& kv: this->connections) {
+        close(kv.first);
+    }
+    close(this->epoll_fd);
+    close(this->event_fd);
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+}
+
+void Server::stop() {
+    this->stopping.store(true);
+    uint64_t one = 1;
+    ssize_t ret = write(this->event_fd, &one, sizeof(one));
+    (void) ret;
+}
+
+void Server::swap(ServingTables* next) {
+    this->tables.swap(next);
+}
+
+void Server::serve() {
+    epoll_event events[kMaxEvents];
+    while (!this->stopping.load()) {
+        int n = epoll_wait(this->epoll_fd, events, kMaxEvents, -1);
+        if (n < 0 && errno != EINTR)
+            throw std::runtime_error("epoll_wait failed!");
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == this->listen_fd) {
+                this->accept_all();
+            } else if (fd == this->event_fd) {
+                uint64_t count;
+                ssize_t ret = read(this->event_fd, &count, sizeof(count));
+                (void) ret;
+                this->collect_replies();
+            } else {
+                auto it = this->connections.find(fd);
+                if (it == this->connections.end())  continue;
+                ConnectionPtr conn = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    this->handle_read(conn);
+                if (conn->fd >= 0 && (events[i].events & EPOLLOUT))
+                    this->handle_write(conn);
+            }
+        }
+    }
+}
+
+void Server::accept_all() {
+    while (true) {
+        int fd = accept(this->listen_fd, nullptr, nullptr);
+        if (fd < 0)  return;
+        set_nonblocking(fd);
+        ConnectionPtr conn = std::make_shared<Connection>(fd);
+        this->connections[fd] = conn;
+        epoll_event ev;
+        ev.events = conn->events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void Server::handle_read(const ConnectionPtr& conn) {
+    if (conn->read_closed) {
+        // Not reading any more, so only a hang-up gets here: the client is gone
+        this->close_connection(conn);
+        return;
+    }
+    char buf[kReadChunk];
+    while (conn->next_seq - conn->next_reply < kMaxInFlight) {
+        ssize_t n = read(conn->fd, buf, sizeof(buf));
+        if (n == 0) {
+            // The client may only have shut down its side, and still wait for
+            // the replies it is owed: they go out before the connection closes
+            if (!conn->in.empty())
+                this->handle_request(conn, conn->in);
+            conn->in.clear();
+            conn->read_closed = true;
+            shutdown(conn->fd, SHUT_RD);
+            break;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            this->close_connection(conn);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR)  continue;
+            break;
+        }
+        conn->in.append(buf, n);
+        size_t begin = 0, end;
+        while ((end = conn->in.find('\n', begin)) != std::string::npos) {
+            this->handle_request(conn, conn->in.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        conn->in.erase(0, begin);
+    }
+    this->update_events(conn);
+    this->close_if_done(conn);
+}
+
+void Server::handle_request(const ConnectionPtr& conn, const std::string& line) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+        return;  // blank lines are not requests
+    long seq = conn->next_seq++;
+    Instruction inst(line);
+    std::string error = this->check(inst, this->tables.read().get());
+    if (!error.empty()) {
+        this->complete(conn, seq, "ERR " + error);
+        return;
+    }
+    this->executor.submit(inst, [this, conn, seq, inst] {
+        // Pinned until the reply is ready, a swap meanwhile does not affect it
+        RcuCell<ServingTables>::Guard tables = this->tables.read();
+        std::string reply = this->check(inst, tables.get());
+        if (reply.empty()) {
+            reply = reply_instruction(inst, tables->users, tables->items, &tables->results);
+        } else {
+            reply = "ERR " + reply;  // the new snapshot is smaller
+        }
+        this->complete(conn, seq, std::move(reply));
+    });
+}
+
+std::string Server::check(const Instruction& inst, ServingTables* tables) {
+    int n_users = tables->users->get_n_embeddings();
+    int n_items = tables->items->get_n_embeddings();
+    const std::vector<int>& p = inst.payloads;
+    auto is_item = [n_items] (int idx) { return idx >= 0 && idx < n_items; };
+    switch (inst.order) {
+        case INIT_EMB:
+            for (int idx: p) {
+                if (!is_item(idx))  return "bad item index";
+            }
+            return "";
+        case UPDATE_EMB:
+            if (p.size() < 3)  return "bad update";
+            if (p[0] < 0 || p[0] >= n_users)  return "bad user index";
+            return is_item(p[1])? "": "bad item index";
+        case RECOMMEND:
+            if (p.size() < 3)  return "bad recommend";
+            if (p[0] < 0 || p[0] >= n_users)  return "bad user index";
+            for (unsigned int i = 2; i < p.size(); ++i) {
+                if (!is_item(p[i]))  return "bad item index";
+            }
+            return "";
+    }
+    return "bad order";
+}
+
+void Server::complete(const ConnectionPtr& conn, long seq, std::string reply) {
+    {
+        std::lock_guard<std::mutex> lk(conn->mutex);
+        conn->replies[seq] = std::move(reply);
+    }
+    {
+        std::lock_guard<std::mutex> lk(this->ready_mutex);
+        this->ready.push_back(conn);
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(this->event_fd, &one, sizeof(one));
+    (void) ret;
+}
+
+void Server::collect_replies() {
+    std::vector<ConnectionPtr> ready;
+    {
+        std::lock_guard<std::mutex> lk(this->ready_mutex);
+        ready.swap(this->ready);
+    }
+    for (const ConnectionPtr& conn: ready) {
+        if (conn->fd < 0)  continue;  // the client is gone
+        {
+            // Only replies that are next in request order can go out
+            std::lock_guard<std::mutex> lk(conn->mutex);
+            auto it = conn->replies.begin();
+            while (it != conn->replies.end() && it->first == conn->next_reply) {
+                conn->out += it->second;
+                conn->out += '\n';
+                ++conn->next_reply;
+                it = conn->replies.erase(it);
+            }
+        }
+        this->handle_write(conn);
+    }
+}
+
+void Server::handle_write(const ConnectionPtr& conn) {
+    while (!conn->out.empty()) {
+        ssize_t n = send(conn->fd, conn->out.data(), conn->out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)  continue;
+            if (errno == EAGAIN)  break;
+            this->close_connection(conn);
+            return;
+        }
+        conn->out.erase(0, n);
+    }
+    // Replies went out, so there may be room for more requests again
+    this->update_events(conn);
+    this->close_if_done(conn);
+}
+
+void Server::update_events(const ConnectionPtr& conn) {
+    if (conn->fd < 0)  return;
+    uint32_t events = 0;
+    if (!conn->read_closed && conn->next_seq - conn->next_reply < kMaxInFlight)
+        events |= EPOLLIN;
+    if (!conn->out.empty())
+        events |= EPOLLOUT;
+    if (events == conn->events)  return;
+    epoll_event ev;
+    ev.events = conn->events = events;
+    ev.data.fd = conn->fd;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void Server::close_if_done(const ConnectionPtr& conn) {
+    if (conn->fd >= 0 && conn->read_closed && conn->next_reply == conn->next_seq
+            && conn->out.empty())
+        this->close_connection(conn);
+}
+
+void Server::close_connection(const ConnectionPtr& conn) {
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    this->connections.erase(conn->fd);
+    conn->fd = -1;
+}
+
+} // namespace proj1
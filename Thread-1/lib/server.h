@@ -0,0 +1,84 @@
+#ifndef THREAD_LIB_SERVER_H_
+#define THREAD_LIB_SERVER_H_
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rcu.h"
+#include "executor.h"
+#include "embedding.h"
+#include "shm_table.h"
+#include "instruction.h"
+#include "recommend_cache.h"
+
+namespace proj1 {
+
+// One served version of the user and item holders, together with the shared
+// tables their rows live in and the cached recommends over them. Everything
+// is freed with it.
+struct ServingTables {
+    ServingTables(EmbeddingHolder* users, EmbeddingHolder* items,
+                  std::vector<SharedTable*> tables = std::vector<SharedTable*>()):
+        users(users), items(items), tables(tables) {}
+    ~ServingTables();
+    EmbeddingHolder* users;
+    EmbeddingHolder* items;
+    std::vector<SharedTable*> tables;
+    RecommendCache results;
+};
+
+// A long-lived recommendation server on a Unix domain socket.
+//
+// Requests are instruction lines in the `*_instruction.tsv` format, one per
+// line, and every request gets exactly one reply line (see
+// `reply_instruction`, or "ERR <reason>" for a malformed request). A client
+// may pipeline any number of requests; they run concurrently on the executor
+// and the replies come back in request order. A client that shuts down its
+// writing side still gets all of its replies before the server closes. All
+// sockets are driven by a single epoll loop, workers hand their replies back
+// through an eventfd.
+//
+// The tables can be replaced by a new snapshot at any time with `swap`.
+// Requests that already started finish on the version they pinned, and
+// the old version is freed once the last of them is done.
+class Server {
+public:
+    Server(std::string socket_path, ServingTables* tables,
+           ExecutorOptions options = ExecutorOptions());
+    ~Server();
+    void serve();  // runs the event loop until `stop` is called
+    void stop();   // async-signal-safe
+    void swap(ServingTables* next);  // thread-safe, takes the ownership
+private:
+    struct Connection;
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    void accept_all();
+    void handle_read(const ConnectionPtr& conn);
+    void handle_request(const ConnectionPtr& conn, const std::string& line);
+    void complete(const ConnectionPtr& conn, long seq, std::string reply);
+    void collect_replies();
+    void handle_write(const ConnectionPtr& conn);
+    void update_events(const ConnectionPtr& conn);
+    void close_if_done(const ConnectionPtr& conn);
+    void close_connection(const ConnectionPtr& conn);
+    std::string check(const Instruction& inst, ServingTables* tables);
+
+    std::string socket_path;
+    RcuCell<ServingTables> tables;
+    int listen_fd;
+    int epoll_fd;
+    int event_fd;
+    std::atomic<bool> stopping;
+    std::map<int, ConnectionPtr> connections;  // loop thread only
+    std::mutex ready_mutex;
+    std::vector<ConnectionPtr> ready;  // connections with new replies
+    Executor executor;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_SERVER_H_
@@ -0,0 +1,91 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <stdexcept>
+#include "shm_table.h"
+
+namespace proj1 {
+
+namespace {
+
+const uint64_t kMagic = 0x31706f7270ULL;  // "proj1"
+
+} // namespace
+
+SharedTable::SharedTable(std::string name, void* base, size_t size, bool owner) :
+        name(std::move(name)),
+        base(base),
+        size(size),
+        owner(owner) {
+    this->header = static_cast<Header*>(base);
+    this->rows = reinterpret_cast<double*>(
+        static_cast<char*>(base) + sizeof(Header));
+}
+
+SharedTable::~SharedTable() {
+    munmap(this->base, this->size);
+    if (this->owner)
+        shm_unlink(this->name.c_str());
+}
+
+SharedTable* SharedTable::create(std::string name, std::string filename) {
+    EmbeddingMatrix matrix = EmbeddingHolder::read(filename);
+    int length = matrix.empty()? 0: matrix[0]->get_length();
+    size_t size = sizeof(Header) + matrix.size() * length * sizeof(double);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Error creating shared memory " + name + "!");
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Error mapping shared memory " + name + "!");
+    }
+
+    SharedTable* table = new SharedTable(name, base, size, true);
+    table->header->n_rows = matrix.size();
+    table->header->length = length;
+    for (unsigned int i = 0; i < matrix.size(); ++i) {
+        memcpy(table->row(i), matrix[i]->get_data(), length * sizeof(double));
+        delete matrix[i];
+    }
+    table->header->magic = kMagic;
+    return table;
+}
+
+SharedTable* SharedTable::attach(std::string name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        throw std::runtime_error("Error opening shared memory " + name + "!");
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(Header))
+        base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("Error mapping shared memory " + name + "!");
+    SharedTable* table = new SharedTable(name, base, st.st_size, false);
+    if (table->header->magic != kMagic) {
+        delete table;
+        throw std::runtime_error("Not an embedding table: " + name + "!");
+    }
+    return table;
+}
+
+EmbeddingHolder* SharedTable::make_holder() {
+    // An update through the holder would write to the read-only mapping
+    if (!this->owner)
+        throw std::runtime_error("An attached table " + this->name + " is read-only!");
+    EmbeddingMatrix matrix;
+    for (int i = 0; i < this->get_n_rows(); ++i) {
+        matrix.push_back(new Embedding(this->get_emb_length(), this->row(i), false));
+    }
+    return new EmbeddingHolder(matrix);
+}
+
+} // namespace proj1
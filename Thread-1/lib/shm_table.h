@@ -0,0 +1,49 @@
+#ifndef THREAD_LIB_SHM_TABLE_H_
+#define THREAD_LIB_SHM_TABLE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "embedding.h"
+
+namespace proj1 {
+
+// An embedding table that is parsed once and then kept in POSIX shared
+// memory, so that a long-lived server (and any other process attaching to the
+// same name) never has to go through `EmbeddingHolder::read` again.
+class SharedTable {
+public:
+    // Creates the segment `name` (e.g. "/proj1_users") from an `*.in` file
+    static SharedTable* create(std::string name, std::string filename);
+    // Maps an existing segment read-only: its rows can only be read, through
+    // `row`, and it makes no holder
+    static SharedTable* attach(std::string name);
+    ~SharedTable();  // the creator also unlinks the segment
+    // A holder whose rows point into the segment. Rows appended later (INIT)
+    // live on the heap as usual. The table has to outlive the holder. Only
+    // the creator's table, which is mapped writable, since updates write to
+    // the rows in place; throws on an attached one.
+    EmbeddingHolder* make_holder();
+    int get_n_rows() { return this->header->n_rows; }
+    int get_emb_length() { return this->header->length; }
+    // Not to be written through on an attached table
+    double* row(int idx) { return this->rows + (size_t) idx * this->header->length; }
+private:
+    struct Header {
+        uint64_t magic;
+        int32_t n_rows;
+        int32_t length;
+    };
+    SharedTable(std::string name, void* base, size_t size, bool owner);
+
+    std::string name;
+    void* base;
+    size_t size;
+    bool owner;  // created it, mapped writable
+    Header* header;
+    double* rows;
+};
+
+} // namespace proj1
+
+#endif // THREAD_LIB_SHM_TABLE_H_
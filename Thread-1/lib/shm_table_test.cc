@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <string>
+#include "shm_table.h"
+
+namespace proj1 {
+namespace testing{
+
+std::string segment_name(const char* base) {
+    return std::string("/") + base + "_" + std::to_string(getpid());
+}
+
+TEST(SharedTableTest, test_same_rows_as_read) {
+    SharedTable* table = SharedTable::create(segment_name("shm_test"), "data/q0.in");
+    EmbeddingHolder* holder = table->make_holder();
+    EmbeddingHolder expected("data/q0.in");
+    EXPECT_EQ(true, (*holder) == expected);
+    EXPECT_EQ(expected.get_n_embeddings(), (unsigned int) table->get_n_rows());
+    delete holder;
+    delete table;
+}
+
+TEST(SharedTableTest, test_attach_sees_updates) {
+    std::string name = segment_name("shm_attach_test");
+    SharedTable* table = SharedTable::create(name, "data/q0.in");
+    SharedTable* other = SharedTable::attach(name);
+    EXPECT_EQ(table->get_emb_length(), other->get_emb_length());
+    table->row(3)[1] = 42.0;
+    EXPECT_EQ(42.0, other->row(3)[1]);
+    // Read-only, so no holder to update its rows through
+    EXPECT_THROW(other->make_holder(), std::runtime_error);
+    delete other;
+    delete table;
+    EXPECT_THROW(SharedTable::attach(name), std::runtime_error);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
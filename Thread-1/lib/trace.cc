@@ -0,0 +1,237 @@
+#include <set>
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "utils.h"
+#include "trace.h"
+
+namespace proj1 {
+
+std::atomic<bool> tracing_on(false);
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    long begin_usec;
+    long dur_usec;
+    int n_args;
+    const char* arg_keys[kTraceArgs];
+    long arg_values[kTraceArgs];
+};
+
+// Written by its thread only, read once the thread is done
+struct ThreadBuffer {
+    int tid;
+    std::atomic<long> n_written;
+    TraceEvent events[kTraceBufferEvents];
+};
+
+std::mutex registry_mutex;  // guards everything below
+std::vector<ThreadBuffer*> buffers;  // never freed, outlive their threads
+std::set<std::string> names;
+std::string trace_path;
+
+thread_local ThreadBuffer* local_buffer = nullptr;
+
+LatencyHistogram histograms[3];
+const char* kOrderNames[3] = {"init", "update", "recommend"};
+
+void append(const TraceEvent& event) {
+    if (local_buffer == nullptr) {
+        std::lock_guard<std::mutex> lk(registry_mutex);
+        local_buffer = new ThreadBuffer();
+        local_buffer->tid = buffers.size() + 1;
+        local_buffer->n_written.store(0);
+        buffers.push_back(local_buffer);
+    }
+    long i = local_buffer->n_written.load(std::memory_order_relaxed);
+    local_buffer->events[i % kTraceBufferEvents] = event;
+    local_buffer->n_written.store(i + 1, std::memory_order_release);
+}
+
+void write_string(std::ostream& os, const char* s) {
+    os << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')  os << '\\';
+        os << *s;
+    }
+    os << '"';
+}
+
+void write_trace(std::ostream& os) {
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (ThreadBuffer* buffer: buffers) {
+        os << (first? "": ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+           << buffer->tid << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+        first = false;
+        long n = buffer->n_written.load(std::memory_order_acquire);
+        for (long i = std::max(0L, n - kTraceBufferEvents); i < n; ++i) {
+            const TraceEvent& e = buffer->events[i % kTraceBufferEvents];
+            os << ",\n{\"ph\":\"X\",\"name\":";
+            write_string(os, e.name);
+            os << ",\"cat\":";
+            write_string(os, e.category);
+            os << ",\"ts\":" << e.begin_usec << ",\"dur\":" << e.dur_usec
+               << ",\"pid\":1,\"tid\":" << buffer->tid;
+            if (e.n_args > 0) {
+                os << ",\"args\":{";
+                for (int a = 0; a < e.n_args; ++a) {
+                    if (a > 0)  os << ',';
+                    write_string(os, e.arg_keys[a]);
+                    os << ':' << e.arg_values[a];
+                }
+                os << '}';
+            }
+            os << '}';
+        }
+    }
+    os << "\n]}\n";
+}
+
+bool start_from_env = [] {
+    const char* path = std::getenv("PROJ1_TRACE");
+    if (path == nullptr || *path == '\0')
+        return false;
+    std::atexit(stop_tracing);
+    return start_tracing(path);
+}();
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : n(0), max_usec(0) {
+    for (std::atomic<long>& bucket: this->buckets) {
+        bucket.store(0);
+    }
+}
+
+int LatencyHistogram::bucket_of(long usec) {
+    if (usec < kSubBuckets)
+        return usec < 0? 0: usec;
+    int exponent = 63 - __builtin_clzl(usec);  // >= 4
+    int sub = (usec >> (exponent - 4)) & (kSubBuckets - 1);
+    return kSubBuckets * (exponent - 3) + sub;
+}
+
+long LatencyHistogram::lower_bound_of(int bucket) {
+    if (bucket < kSubBuckets)
+        return bucket;
+    int exponent = bucket / kSubBuckets + 3;
+    return (long) (kSubBuckets + bucket % kSubBuckets) << (exponent - 4);
+}
+
+void LatencyHistogram::record(long usec) {
+    this->buckets[bucket_of(usec)].fetch_add(1, std::memory_order_relaxed);
+    this->n.fetch_add(1, std::memory_order_relaxed);
+    long max = this->max_usec.load(std::memory_order_relaxed);
+    while (usec > max && !this->max_usec.compare_exchange_weak(max, usec)) {}
+}
+
+long LatencyHistogram::count() const {
+    return this->n.load();
+}
+
+long LatencyHistogram::max() const {
+    return this->max_usec.load();
+}
+
+long LatencyHistogram::percentile(double p) const {
+    long target = (long) (p * this->count());
+    long seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += this->buckets[i].load(std::memory_order_relaxed);
+        if (seen > target)
+            return lower_bound_of(i);
+    }
+    return this->max();
+}
+
+LatencyHistogram& instruction_histogram(int order) {
+    return histograms[order];
+}
+
+bool start_tracing(const std::string& path) {
+    std::ofstream probe(path);
+    if (!probe.is_open()) {
+        std::cerr << "Error opening trace file " << path << "!" << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lk(registry_mutex);
+        trace_path = path;
+        // Nothing is traced while off, drop what the last run left behind
+        for (ThreadBuffer* buffer: buffers) {
+            buffer->n_written.store(0);
+        }
+    }
+    tracing_on.store(true);
+    return true;
+}
+
+void stop_tracing() {
+    if (!tracing_on.exchange(false))
+        return;
+    std::lock_guard<std::mutex> lk(registry_mutex);
+    std::ofstream ofs(trace_path);
+    write_trace(ofs);
+    for (int order = 0; order < 3; ++order) {
+        const LatencyHistogram& h = histograms[order];
+        if (h.count() == 0)
+            continue;
+        std::cerr << "trace : " << kOrderNames[order] << " " << h.count()
+                  << " done, p50 " << h.percentile(0.5) << ", p90 " << h.percentile(0.9)
+                  << ", p99 " << h.percentile(0.99) << ", p999 " << h.percentile(0.999)
+                  << ", max " << h.max() << " usec\n";
+    }
+    std::cerr << "trace : written to " << trace_path << std::endl;
+}
+
+void trace_complete(const char* name, const char* category,
+                    long begin_usec, long end_usec) {
+    if (!tracing())
+        return;
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.begin_usec = begin_usec;
+    event.dur_usec = end_usec - begin_usec;
+    event.n_args = 0;
+    append(event);
+}
+
+void TraceScope::begin(const char* name, const char* category,
+                       LatencyHistogram* histogram) {
+    this->name = name;
+    this->category = category;
+    this->histogram = histogram;
+    this->n_args = 0;
+    this->begin_usec = usec_since_start();
+}
+
+void TraceScope::finish() {
+    long end_usec = usec_since_start();
+    if (this->histogram != nullptr)
+        this->histogram->record(end_usec - this->begin_usec);
+    TraceEvent event;
+    event.name = this->name;
+    event.category = this->category;
+    event.begin_usec = this->begin_usec;
+    event.dur_usec = end_usec - this->begin_usec;
+    event.n_args = this->n_args;
+    for (int i = 0; i < this->n_args; ++i) {
+        event.arg_keys[i] = this->arg_keys[i];
+        event.arg_values[i] = this->arg_values[i];
+    }
+    append(event);
+}
+
+const char* trace_name(const std::string& name) {
+    std::lock_guard<std::mutex> lk(registry_mutex);
+    return names.insert(name).first->c_str();
+}
+
+} // namespace proj1
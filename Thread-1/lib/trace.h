@@ -0,0 +1,98 @@
+#ifndef THREAD_LIB_TRACE_H_
+#define THREAD_LIB_TRACE_H_
+
+#include <atomic>
+#include <string>
+
+namespace proj1 {
+
+// Low-overhead tracing into per-thread ring buffers, written out as a
+// Chrome / Perfetto trace (chrome://tracing, ui.perfetto.dev).
+//
+// Tracing is off unless `start_tracing` is called, or `PROJ1_TRACE` names
+// the output file in the environment; off, a scope costs one relaxed load.
+// Each thread keeps its last `kTraceBufferEvents` events. The trace and a
+// latency summary per instruction type are written by `stop_tracing`, which
+// runs at exit when tracing was started from the environment. Timestamps
+// follow `usec_since_start`, so they are simulated in virtual mode.
+
+const int kTraceBufferEvents = 1 << 14;
+const int kTraceArgs = 3;
+
+extern std::atomic<bool> tracing_on;
+
+inline bool tracing() {
+    return tracing_on.load(std::memory_order_relaxed);
+}
+
+// Buckets that keep about 6% relative precision from 1 usec to ages, like an
+// HDR histogram with one significant digit. Thread-safe.
+class LatencyHistogram {
+public:
+    static const int kSubBuckets = 16;
+    static const int kBuckets = kSubBuckets * 60;
+    LatencyHistogram();
+    void record(long usec);
+    long count() const;
+    long max() const;
+    long percentile(double p) const;  // lower bound of the bucket
+private:
+    static int bucket_of(long usec);
+    static long lower_bound_of(int bucket);
+    std::atomic<long> buckets[kBuckets];
+    std::atomic<long> n;
+    std::atomic<long> max_usec;
+};
+
+// The histogram of the instructions of an `InstructionOrder`
+LatencyHistogram& instruction_histogram(int order);
+
+bool start_tracing(const std::string& path);
+void stop_tracing();  // once the traced threads are done
+
+// Records a finished span. `name` and `category` must outlive the tracing.
+void trace_complete(const char* name, const char* category,
+                    long begin_usec, long end_usec);
+
+// A span from construction to `end` or destruction, with up to `kTraceArgs`
+// integer arguments, optionally recorded in a histogram too.
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category,
+               LatencyHistogram* histogram = nullptr) {
+        this->active = tracing();
+        if (this->active)
+            this->begin(name, category, histogram);
+    }
+    ~TraceScope() { this->end(); }
+    TraceScope& arg(const char* key, long value) {
+        if (this->active && this->n_args < kTraceArgs) {
+            this->arg_keys[this->n_args] = key;
+            this->arg_values[this->n_args++] = value;
+        }
+        return *this;
+    }
+    void end() {
+        if (this->active)
+            this->finish();
+        this->active = false;
+    }
+private:
+    void begin(const char* name, const char* category, LatencyHistogram* histogram);
+    void finish();
+    bool active;
+    const char* name;
+    const char* category;
+    LatencyHistogram* histogram;
+    long begin_usec;
+    int n_args;
+    const char* arg_keys[kTraceArgs];
+    long arg_values[kTraceArgs];
+};
+
+// An interned copy of `name`, for the names that are not literals
+const char* trace_name(const std::string& name);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_TRACE_H_
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include "trace.h"
+
+namespace proj1 {
+namespace testing{
+
+int count(const std::string& s, const std::string& what) {
+    int n = 0;
+    for (size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) ++n;
+    return n;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+TEST(TraceTest, test_histogram_percentiles) {
+    LatencyHistogram h;
+    for (long usec = 1; usec <= 10000; ++usec) {
+        h.record(usec);
+    }
+    EXPECT_EQ(10000, h.count());
+    EXPECT_EQ(10000, h.max());
+    // Within the bucket precision of the exact ranks
+    EXPECT_NEAR(5000, h.percentile(0.5), 5000 / 16);
+    EXPECT_NEAR(9900, h.percentile(0.99), 9900 / 16);
+    EXPECT_EQ(0, LatencyHistogram().percentile(0.5));
+}
+
+TEST(TraceTest, test_trace_file) {
+    std::string path = "/tmp/proj1_trace_test_" + std::to_string(getpid()) + ".json";
+    {
+        TraceScope off("not_traced", "test");
+    }
+    ASSERT_TRUE(start_tracing(path));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < 10; ++i) {
+                TraceScope scope("work", "test", &instruction_histogram(1));
+                scope.arg("thread", t).arg("i", i);
+            }
+        });
+    }
+    for (std::thread& t: threads) t.join();
+    trace_complete("queued", "queue", 10, 20);
+    stop_tracing();
+    {
+        TraceScope after("not_traced", "test");
+    }
+
+    std::string trace = read_file(path);
+    EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    EXPECT_EQ(40, count(trace, "\"name\":\"work\""));
+    EXPECT_EQ(1, count(trace, "\"name\":\"queued\",\"cat\":\"queue\",\"ts\":10,\"dur\":10"));
+    EXPECT_EQ(0, count(trace, "not_traced"));
+    EXPECT_EQ(1, count(trace, "\"args\":{\"thread\":2,\"i\":7}"));
+    EXPECT_EQ(40, instruction_histogram(1).count());
+    std::remove(path.c_str());
+}
+
+TEST(TraceTest, test_ring_keeps_the_last_events) {
+    std::string path = "/tmp/proj1_trace_ring_" + std::to_string(getpid()) + ".json";
+    ASSERT_TRUE(start_tracing(path));
+    std::thread t([] {
+        for (int i = 0; i < kTraceBufferEvents + 100; ++i) {
+            TraceScope scope("spin", "test");
+            scope.arg("i", i);
+        }
+    });
+    t.join();
+    stop_tracing();
+    std::string trace = read_file(path);
+    EXPECT_EQ(kTraceBufferEvents, count(trace, "\"name\":\"spin\""));
+    EXPECT_EQ(0, count(trace, "\"args\":{\"i\":99}"));
+    EXPECT_EQ(1, count(trace, "\"args\":{\"i\":100}"));
+    std::remove(path.c_str());
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
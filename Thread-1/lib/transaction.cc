@@ -0,0 +1,84 @@
+#include <chrono>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include "model.h"
+#include "trace.h"
+#include "transaction.h"
+
+namespace proj1 {
+
+namespace {
+
+const int kMinBackoffUsec = 1;
+const int kMaxBackoffUsec = 1000;
+
+} // namespace
+
+std::atomic<long> RowTransaction::n_retries(0);
+
+RowTransaction& RowTransaction::add(EmbeddingHolder* holder, int idx) {
+    Mutex* lock = &holder->row_lock(idx);
+    auto it = std::lower_bound(this->locks.begin(), this->locks.end(), lock,
+                               std::less<Mutex*>());
+    if (it == this->locks.end() || *it != lock)
+        this->locks.insert(it, lock);
+    return *this;
+}
+
+void RowTransaction::lock() {
+    static thread_local std::minstd_rand rng(
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+    TraceScope wait("row_lock_wait", "lock");
+    wait.arg("rows", this->locks.size());
+    int backoff = kMinBackoffUsec;
+    size_t first = 0;  // the lock to block on, holding nothing
+    while (true) {
+        this->locks[first]->lock();
+        size_t failed = this->locks.size();
+        for (size_t i = 0; i < this->locks.size(); ++i) {
+            if (i != first && !this->locks[i]->try_lock()) {
+                failed = i;
+                break;
+            }
+        }
+        if (failed == this->locks.size())
+            break;
+        // Release everything we got and try again later
+        for (size_t i = 0; i < failed; ++i) {
+            this->locks[i]->unlock();
+        }
+        if (first > failed)
+            this->locks[first]->unlock();
+        n_retries.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::sleep_for(std::chrono::microseconds(
+            std::uniform_int_distribution<int>(0, backoff)(rng)));
+        backoff = std::min(kMaxBackoffUsec, backoff * 2);
+        first = failed;
+    }
+    this->held = true;
+}
+
+void RowTransaction::unlock() {
+    for (auto it = this->locks.rbegin(); it != this->locks.rend(); ++it) {
+        (*it)->unlock();
+    }
+    this->held = false;
+}
+
+void update_pair(EmbeddingHolder* users, int user_idx,
+                 EmbeddingHolder* items, int item_idx, int label) {
+    RowTransaction txn;
+    txn.add(users, user_idx).add(items, item_idx).lock();
+    Embedding* user = users->get_embedding(user_idx);
+    Embedding* item = items->get_embedding(item_idx);
+    EmbeddingGradient* gradient = calc_gradient(user, item, label);
+    users->update_embedding(user_idx, gradient, 0.01);
+    delete gradient;
+    gradient = calc_gradient(item, user, label);
+    items->update_embedding(item_idx, gradient, 0.001);
+    delete gradient;
+    txn.unlock();
+}
+
+} // namespace proj1
@@ -0,0 +1,44 @@
+#ifndef THREAD_LIB_TRANSACTION_H_
+#define THREAD_LIB_TRANSACTION_H_
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include "embedding.h"
+
+namespace proj1 {
+
+// Locks a set of rows, from one or several holders, all or nothing.
+//
+// The row locks are taken in one global order (by address, which also merges
+// rows that share a stripe), so two transactions can never wait on each other
+// in a cycle. On top of that a transaction never waits while holding locks:
+// if a lock is contended it releases everything it has, backs off for a
+// randomized, growing time and starts over, blocking only on the lock that
+// was contended while holding none.
+class RowTransaction {
+public:
+    RowTransaction() : held(false) {}
+    ~RowTransaction() { if (this->held) this->unlock(); }
+    RowTransaction& add(EmbeddingHolder* holder, int idx);
+    void lock();
+    void unlock();
+    static long get_n_retries() { return n_retries.load(); }
+private:
+    RowTransaction(const RowTransaction&) = delete;
+    RowTransaction& operator=(const RowTransaction&) = delete;
+    std::vector<Mutex*> locks;
+    bool held;
+    static std::atomic<long> n_retries;  // over all transactions
+};
+
+// UPDATE_EMB as one transaction: both rows are locked together, the paired
+// `calc_gradient`s read them and `update_embedding` writes them back before
+// anything is released. Serializable, at the price of holding both rows
+// over the slow gradient calls.
+void update_pair(EmbeddingHolder* users, int user_idx,
+                 EmbeddingHolder* items, int item_idx, int label);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_TRANSACTION_H_
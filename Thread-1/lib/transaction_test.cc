@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "model.h"
+#include "runner.h"
+#include "transaction.h"
+#include "utils.h"
+
+namespace proj1 {
+namespace testing{
+
+EmbeddingHolder* make_holder(int n_rows) {
+    EmbeddingMatrix matrix;
+    for (int i = 0; i < n_rows; ++i) {
+        matrix.push_back(new Embedding(4));
+    }
+    return new EmbeddingHolder(matrix);
+}
+
+TEST(TransactionTest, test_opposite_orders_do_not_deadlock) {
+    EmbeddingHolder* a = make_holder(2);
+    EmbeddingHolder* b = make_holder(2);
+    long counter = 0;  // only touched with both rows locked
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 2000; ++i) {
+                RowTransaction txn;
+                // Half of the threads name the rows the other way around
+                if (t % 2 == 0) {
+                    txn.add(a, 0).add(b, 1);
+                } else {
+                    txn.add(b, 1).add(a, 0);
+                }
+                txn.lock();
+                ++counter;
+            }
+        });
+    }
+    for (std::thread& t: threads) t.join();
+    EXPECT_EQ(8000, counter);
+    delete a;
+    delete b;
+}
+
+TEST(TransactionTest, test_shared_stripe) {
+    EmbeddingHolder* holder = make_holder(kRowLockStripes + 1);
+    RowTransaction txn;
+    // Rows 0 and kRowLockStripes share a lock, it must only be taken once
+    txn.add(holder, 0).add(holder, kRowLockStripes);
+    txn.lock();
+    txn.unlock();
+    delete holder;
+}
+
+TEST(TransactionTest, test_update_pair_same_as_serial) {
+    EmbeddingHolder* users = make_holder(3);
+    EmbeddingHolder* items = make_holder(3);
+    EmbeddingHolder* expected_users = make_holder(3);
+    EmbeddingHolder* expected_items = make_holder(3);
+    update_pair(users, 1, items, 2, 1);
+    // What q0 does for "1 1 2 1"
+    Embedding* user = expected_users->get_embedding(1);
+    Embedding* item = expected_items->get_embedding(2);
+    EmbeddingGradient* gradient = calc_gradient(user, item, 1);
+    expected_users->update_embedding(1, gradient, 0.01);
+    delete gradient;
+    gradient = calc_gradient(item, user, 1);
+    expected_items->update_embedding(2, gradient, 0.001);
+    delete gradient;
+    EXPECT_EQ(true, (*users) == (*expected_users));
+    EXPECT_EQ(true, (*items) == (*expected_items));
+    EXPECT_EQ(false, (*users->get_embedding(1)) == (*users->get_embedding(0)));
+    delete users;
+    delete items;
+    delete expected_users;
+    delete expected_items;
+}
+
+TEST(TransactionTest, test_concurrent_updates_are_serializable) {
+    EmbeddingHolder* users = make_holder(2);
+    EmbeddingHolder* items = make_holder(2);
+    EmbeddingHolder* expected_users = make_holder(2);
+    EmbeddingHolder* expected_items = make_holder(2);
+    // A short real latency opens a window between reading and writing the rows
+    SlowFunctionOptions saved = get_slow_function();
+    set_slow_function(parse_slow_function_options("real,latency_scale=0.00001"));
+    // The same update from every thread: any serial order gives one result
+    Instruction inst("1 1 0 1");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 50; ++i) {
+                run_instruction(inst, users, items);
+            }
+        });
+    }
+    for (std::thread& t: threads) t.join();
+    set_slow_function(saved);
+    for (int i = 0; i < 8 * 50; ++i) {
+        update_pair(expected_users, 1, expected_items, 0, 1);
+    }
+    // None was computed from rows another one changed in the meantime
+    EXPECT_EQ(true, (*users) == (*expected_users));
+    EXPECT_EQ(true, (*items) == (*expected_items));
+    delete users;
+    delete items;
+    delete expected_users;
+    delete expected_items;
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <chrono>
+#include <stdexcept>
 #include "utils.h"
 
 namespace proj1 {
@@ -13,6 +15,45 @@ TEST(UtilTest, test_sigmoid_backward) {
     EXPECT_NEAR(0.196612, sigmoid_backward(1.0), 0.0001);   
 }
 
+TEST(UtilTest, test_parse_slow_function_options) {
+    SlowFunctionOptions options =
+        parse_slow_function_options("virtual,lognormal,sigma=0.25,time_scale=100");
+    EXPECT_EQ(SLOW_VIRTUAL, options.mode);
+    EXPECT_EQ(LOGNORMAL_LATENCY, options.distribution);
+    EXPECT_DOUBLE_EQ(0.25, options.sigma);
+    EXPECT_DOUBLE_EQ(100, options.time_scale);
+    EXPECT_THROW(parse_slow_function_options("virtual,time_scale=0"), std::runtime_error);
+    EXPECT_THROW(parse_slow_function_options("sigma"), std::runtime_error);
+    EXPECT_THROW(parse_slow_function_options("fast"), std::runtime_error);
+}
+
+TEST(UtilTest, test_virtual_slow_function) {
+    SlowFunctionOptions saved = get_slow_function();
+    set_slow_function(parse_slow_function_options("virtual,time_scale=10000"));
+    long start = usec_since_start();
+    auto wall_start = std::chrono::steady_clock::now();
+    a_slow_function(10);
+    auto wall = std::chrono::steady_clock::now() - wall_start;
+    // 10 simulated seconds, 1 ms of wall time
+    EXPECT_GE(usec_since_start() - start, 10 * 1000 * 1000);
+    EXPECT_LT(wall, std::chrono::milliseconds(500));
+    set_slow_function(saved);
+}
+
+TEST(UtilTest, test_lognormal_mean) {
+    SlowFunctionOptions saved = get_slow_function();
+    set_slow_function(parse_slow_function_options(
+        "virtual,lognormal,sigma=1,time_scale=1000000000"));
+    SlowFunctionStats before = get_slow_function_stats();
+    for (int i = 0; i < 20000; ++i) {
+        a_slow_function(2);
+    }
+    SlowFunctionStats after = get_slow_function_stats();
+    EXPECT_EQ(20000, after.n_calls - before.n_calls);
+    EXPECT_NEAR(2.0, (after.total_seconds - before.total_seconds) / 20000, 0.1);
+    set_slow_function(saved);
+}
+
 } // namespace testing
 } // namespace proj1
 
@@ -3,12 +3,127 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
 #include "utils.h"
+#include "trace.h"
 
 namespace proj1 {
 
+static const auto kProgramStart = std::chrono::steady_clock::now();
+
+namespace {
+
+SlowFunctionOptions options_from_env() {
+    const char* spec = std::getenv("PROJ1_SLOW");
+    if (spec == nullptr)
+        return SlowFunctionOptions();
+    try {
+        return parse_slow_function_options(spec);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << " Running without a_slow_function." << std::endl;
+        return SlowFunctionOptions();
+    }
+}
+
+SlowFunctionOptions slow_options = options_from_env();
+std::atomic<long> n_slow_calls(0);
+std::atomic<long> total_slow_usec(0);
+std::atomic<unsigned long> n_rng_threads(0);
+
+double draw_latency(double mean) {
+    if (slow_options.distribution == FIXED_LATENCY || mean <= 0)
+        return mean;
+    thread_local std::mt19937_64 rng(slow_options.seed + n_rng_threads++);
+    double sigma = slow_options.sigma;
+    // E[exp(N(mu, sigma^2))] = exp(mu + sigma^2 / 2)
+    std::lognormal_distribution<double> lognormal(std::log(mean) - sigma * sigma / 2, sigma);
+    return lognormal(rng);
+}
+
+} // namespace
+
+SlowFunctionOptions::SlowFunctionOptions() :
+        mode(SLOW_OFF),
+        distribution(FIXED_LATENCY),
+        latency_scale(1.0),
+        sigma(0.5),
+        time_scale(1000.0),
+        seed(1) {}
+
+SlowFunctionOptions parse_slow_function_options(const std::string& spec) {
+    SlowFunctionOptions options;
+    std::stringstream ss(spec);
+    std::string token;
+    while (std::getline(ss, token, ',')) {
+        size_t eq = token.find('=');
+        std::string key = token.substr(0, eq);
+        double value = 0;
+        if (eq != std::string::npos) {
+            std::stringstream vs(token.substr(eq + 1));
+            if (!(vs >> value) || !vs.eof())
+                throw std::runtime_error("Bad value in slow function spec " + token + "!");
+        }
+        if (token == "off")             options.mode = SLOW_OFF;
+        else if (token == "real")       options.mode = SLOW_REAL;
+        else if (token == "virtual")    options.mode = SLOW_VIRTUAL;
+        else if (token == "fixed")      options.distribution = FIXED_LATENCY;
+        else if (token == "lognormal")  options.distribution = LOGNORMAL_LATENCY;
+        else if (eq == std::string::npos)
+            throw std::runtime_error("Bad slow function spec " + token + "!");
+        else if (key == "latency_scale" && value >= 0)  options.latency_scale = value;
+        else if (key == "sigma" && value >= 0)          options.sigma = value;
+        else if (key == "time_scale" && value > 0)      options.time_scale = value;
+        else if (key == "seed" && value >= 0)           options.seed = (unsigned long) value;
+        else
+            throw std::runtime_error("Bad slow function spec " + token + "!");
+    }
+    return options;
+}
+
+void set_slow_function(const SlowFunctionOptions& options) {
+    slow_options = options;
+}
+
+const SlowFunctionOptions& get_slow_function() {
+    return slow_options;
+}
+
+SlowFunctionStats get_slow_function_stats() {
+    SlowFunctionStats stats;
+    stats.n_calls = n_slow_calls.load();
+    stats.total_seconds = total_slow_usec.load() / 1e6;
+    return stats;
+}
+
 void a_slow_function(int seconds) {
-    //std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    if (slow_options.mode == SLOW_OFF)
+        return;
+    double latency = draw_latency(seconds * slow_options.latency_scale);
+    long usec = (long) (latency * 1e6);
+    n_slow_calls.fetch_add(1, std::memory_order_relaxed);
+    total_slow_usec.fetch_add(usec, std::memory_order_relaxed);
+    // A wake-up at a fixed point of the (simulated) clock, so that time spent
+    // getting here does not add to the latency
+    auto wake = std::chrono::steady_clock::now() + to_wall_time(usec);
+    std::this_thread::sleep_until(wake);
+}
+
+long usec_since_start() {
+    long usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - kProgramStart).count();
+    if (slow_options.mode == SLOW_VIRTUAL)
+        return (long) (usec * slow_options.time_scale);
+    return usec;
+}
+
+std::chrono::microseconds to_wall_time(long usec) {
+    if (slow_options.mode == SLOW_VIRTUAL)
+        usec = (long) (usec / slow_options.time_scale);
+    return std::chrono::microseconds(usec);
 }
 
 double sigmoid(double x) {
@@ -33,13 +148,26 @@ double binary_cross_entropy_backward(double y_true, double y_pred) {
 
 AutoTimer::AutoTimer(std::string name) : 
         m_name(std::move(name)),
-        m_beg(std::chrono::high_resolution_clock::now()) { 
+        m_beg(std::chrono::high_resolution_clock::now()),
+        m_virtual_beg(usec_since_start()) { 
+    if (perf_counting()) {
+        // Inherited, to count the threads started in the scope too
+        m_perf.reset(new PerfCounters(true));
+        m_perf_beg = m_perf->read();
     }
+}
 
 AutoTimer::~AutoTimer() {
     auto end = std::chrono::high_resolution_clock::now();
     auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - m_beg);
-    std::cout << m_name << " : " << dur.count() << " usec\n";
+    if (tracing())
+        trace_complete(trace_name(m_name), "timer", m_virtual_beg, usec_since_start());
+    std::cout << m_name << " : " << dur.count() << " usec";
+    if (slow_options.mode == SLOW_VIRTUAL)
+        std::cout << " (" << usec_since_start() - m_virtual_beg << " usec simulated)";
+    if (m_perf)
+        std::cout << ", " << format_perf_sample(m_perf->read() - m_perf_beg);
+    std::cout << "\n";
 }
 
 } // namespace proj1
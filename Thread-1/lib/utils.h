@@ -2,9 +2,11 @@
 #define THREAD_LIB_UTILS_H_
 
 #include <string>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <chrono>  // for AutoTimer function
+#include "perf_counters.h"
 
 // For colored outputs in terminal
 #define RST  "\x1B[0m"
@@ -41,8 +43,59 @@ inline void embbedingAssert(bool condition, char const *msg, T error) {
     }
 }
 
+enum SlowMode {
+    SLOW_OFF = 0,  // returns at once
+    SLOW_REAL,     // sleeps for the latency
+    SLOW_VIRTUAL   // sleeps on a clock running `time_scale` times faster
+};
+
+enum LatencyDistribution {
+    FIXED_LATENCY = 0,
+    LOGNORMAL_LATENCY  // with the requested latency as its mean
+};
+
+struct SlowFunctionOptions {
+    SlowFunctionOptions();
+    SlowMode mode;
+    LatencyDistribution distribution;
+    double latency_scale;  // multiplies the seconds asked of a_slow_function
+    double sigma;          // of the lognormal's underlying normal
+    double time_scale;     // simulated seconds per wall second when virtual
+    unsigned long seed;
+};
+
+// Parses a spec such as "virtual,lognormal,sigma=0.5,time_scale=1000": the
+// words set the mode and the distribution, the pairs set the numbers. The
+// options start from `PROJ1_SLOW` in the environment, if it is set, and
+// are off otherwise. Throws on a bad spec.
+SlowFunctionOptions parse_slow_function_options(const std::string& spec);
+
+// Not thread-safe, set it before starting any thread
+void set_slow_function(const SlowFunctionOptions& options);
+const SlowFunctionOptions& get_slow_function();
+
+struct SlowFunctionStats {
+    long n_calls;
+    double total_seconds;  // simulated latency, summed over all calls
+};
+SlowFunctionStats get_slow_function_stats();
+
+// Stands for a remote call that takes `seconds` (scaled, and drawn from the
+// distribution, by the options above).
+//
+// In virtual mode every call is a wake-up scheduled on the simulated clock,
+// which `usec_since_start` follows: makespans and recommend delays come out
+// as if the calls had really taken that long, in a fraction of the time.
+// Keep `time_scale` low enough that the real computation stays negligible.
 void a_slow_function(int seconds);
 
+// Microseconds since the program started, the clock against which the spec
+// measures the delay of recommend results. Simulated in virtual mode.
+long usec_since_start();
+
+// The wall time a span of `usec_since_start` takes
+std::chrono::microseconds to_wall_time(long usec);
+
 double sigmoid(double x);
 
 double sigmoid_backward(double x);
@@ -58,6 +111,9 @@ class AutoTimer {
  private:
   std::string m_name;
   std::chrono::time_point<std::chrono::high_resolution_clock> m_beg;
+  long m_virtual_beg;
+  std::unique_ptr<PerfCounters> m_perf;  // when perf counting is on
+  PerfSample m_perf_beg;
 };
 
 } // namespace proj1
@@ -0,0 +1,169 @@
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+#include "workload.h"
+#include "instruction.h"
+
+namespace proj1 {
+
+ZipfSampler::ZipfSampler(int n, double skew) : cdf(std::max(1, n)) {
+    double sum = 0;
+    for (int k = 0; k < (int) this->cdf.size(); ++k) {
+        sum += 1.0 / std::pow(k + 1.0, skew);
+        this->cdf[k] = sum;
+    }
+    for (double& p: this->cdf) {
+        p /= sum;
+    }
+}
+
+int ZipfSampler::operator()(std::mt19937_64& rng) const {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    int k = std::upper_bound(this->cdf.begin(), this->cdf.end(), u) - this->cdf.begin();
+    return std::min(k, (int) this->cdf.size() - 1);
+}
+
+WorkloadOptions::WorkloadOptions() :
+        n_instructions(100000),
+        n_users(10000),
+        n_items(10000),
+        init_share(0.01),
+        update_share(0.8),
+        recommend_share(0.19),
+        user_skew(0.99),
+        item_skew(0.99),
+        n_epochs(10),
+        min_pool(10),
+        max_pool(100),
+        init_items(10),
+        loaded_users(false),
+        seed(1) {}
+
+void set_workload_option(WorkloadOptions* options, const std::string& key,
+                         const std::string& value) {
+    std::stringstream ss(value);
+    bool ok = false;
+    if (key == "instructions")  ok = (bool) (ss >> options->n_instructions);
+    else if (key == "users")    ok = (bool) (ss >> options->n_users);
+    else if (key == "items")    ok = (bool) (ss >> options->n_items);
+    else if (key == "init")     ok = (bool) (ss >> options->init_share);
+    else if (key == "update")   ok = (bool) (ss >> options->update_share);
+    else if (key == "recommend") ok = (bool) (ss >> options->recommend_share);
+    else if (key == "user_skew") ok = (bool) (ss >> options->user_skew);
+    else if (key == "item_skew") ok = (bool) (ss >> options->item_skew);
+    else if (key == "epochs")   ok = (bool) (ss >> options->n_epochs);
+    else if (key == "min_pool") ok = (bool) (ss >> options->min_pool);
+    else if (key == "max_pool") ok = (bool) (ss >> options->max_pool);
+    else if (key == "init_items") ok = (bool) (ss >> options->init_items);
+    else if (key == "loaded_users") ok = (bool) (ss >> options->loaded_users);
+    else if (key == "seed")     ok = (bool) (ss >> options->seed);
+    else
+        throw std::runtime_error("Unknown workload option " + key + "!");
+    if (!ok || !ss.eof())
+        throw std::runtime_error("Bad value " + value + " for " + key + "!");
+}
+
+void generate_embeddings(std::ostream& out, int n_rows, int dim, unsigned long seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::ostringstream line;
+    line << std::setprecision(17);
+    for (int i = 0; i < n_rows; ++i) {
+        line.str("");
+        for (int j = 0; j < dim; ++j) {
+            if (j > 0)  line << ',';
+            line << uniform(rng);
+        }
+        out << line.str() << '\n';
+    }
+}
+
+namespace {
+
+// `n` distinct items, hot ones first choice. Falls back to the cold end when
+// the hot ranks keep coming up again.
+std::vector<int> sample_items(int n, const ZipfSampler& items, std::mt19937_64& rng) {
+    n = std::min(n, items.size());
+    std::unordered_set<int> seen;
+    std::vector<int> pool;
+    for (int tries = 0; (int) pool.size() < n && tries < 4 * n; ++tries) {
+        int item = items(rng);
+        if (seen.insert(item).second)
+            pool.push_back(item);
+    }
+    for (int item = items.size() - 1; (int) pool.size() < n; --item) {
+        if (seen.insert(item).second)
+            pool.push_back(item);
+    }
+    return pool;
+}
+
+} // namespace
+
+void generate_instructions(std::ostream& out, const WorkloadOptions& options) {
+    if (options.n_users <= 0 || options.n_items <= 0)
+        throw std::runtime_error("A workload needs some users and items!");
+    if (options.min_pool <= 0 || options.max_pool < options.min_pool)
+        throw std::runtime_error("Bad recommend pool sizes!");
+    double total = options.init_share + options.update_share + options.recommend_share;
+    if (options.init_share < 0 || options.update_share < 0 ||
+            options.recommend_share < 0 || total <= 0)
+        throw std::runtime_error("Bad instruction mix!");
+
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    std::vector<InstructionOrder> orders(options.n_instructions);
+    long n_inits = 0;
+    for (InstructionOrder& order: orders) {
+        double u = uniform(rng);
+        order = u < options.init_share? INIT_EMB:
+            u < options.init_share + options.update_share? UPDATE_EMB: RECOMMEND;
+        n_inits += order == INIT_EMB;
+    }
+
+    // Sized for the users appended on the way, the ones that do not exist
+    // yet are drawn again
+    ZipfSampler users(options.n_users + n_inits, options.user_skew);
+    ZipfSampler items(options.n_items, options.item_skew);
+    std::uniform_int_distribution<int> pool_size(options.min_pool, options.max_pool);
+    long n_users = options.n_users;
+    auto sample_user = [&] {
+        int user;
+        do {
+            user = users(rng);
+        } while (user >= (options.loaded_users? options.n_users: n_users));
+        return user;
+    };
+
+    std::ostringstream line;
+    for (long i = 0; i < options.n_instructions; ++i) {
+        int epoch = options.n_epochs <= 0? -1: i * options.n_epochs / options.n_instructions;
+        line.str("");
+        line << orders[i];
+        switch (orders[i]) {
+            case INIT_EMB:
+                for (int item: sample_items(options.init_items, items, rng)) {
+                    line << ' ' << item;
+                }
+                ++n_users;
+                break;
+            case UPDATE_EMB:
+                line << ' ' << sample_user() << ' ' << items(rng) << ' ' << (int) (rng() & 1);
+                if (epoch >= 0)
+                    line << ' ' << epoch;
+                break;
+            case RECOMMEND:
+                line << ' ' << sample_user() << ' ' << std::max(-1, epoch - 1);
+                for (int item: sample_items(pool_size(rng), items, rng)) {
+                    line << ' ' << item;
+                }
+                break;
+        }
+        out << line.str() << '\n';
+    }
+}
+
+} // namespace proj1
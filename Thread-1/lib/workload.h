@@ -0,0 +1,65 @@
+#ifndef THREAD_LIB_WORKLOAD_H_
+#define THREAD_LIB_WORKLOAD_H_
+
+#include <random>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace proj1 {
+
+// Draws ranks in [0, n) with P(k) proportional to 1 / (k + 1)^skew, so rank
+// 0 is the hottest. A skew of 0 is uniform.
+class ZipfSampler {
+public:
+    ZipfSampler(int n, double skew);
+    int operator()(std::mt19937_64& rng) const;
+    int size() const { return this->cdf.size(); }
+private:
+    std::vector<double> cdf;
+};
+
+struct WorkloadOptions {
+    WorkloadOptions();
+    long n_instructions;
+    int n_users;          // rows in the user table the stream starts from
+    int n_items;
+    double init_share;    // the mix of instructions, normalized on use
+    double update_share;
+    double recommend_share;
+    double user_skew;     // Zipf skew over the user indices, lower is hotter
+    double item_skew;     // ... and over the item indices
+    int n_epochs;         // 0: updates carry no epoch, recommends see -1
+    int min_pool;         // recommend pool sizes are uniform in this range
+    int max_pool;
+    int init_items;       // items watched by a cold-started user
+    bool loaded_users;    // updates and recommends only name the first n_users
+    unsigned long seed;
+};
+
+// Sets the option `key` from its text `value`, as the generator tool takes
+// them on the command line. Throws on an unknown key or a bad value.
+void set_workload_option(WorkloadOptions* options, const std::string& key,
+                         const std::string& value);
+
+// Writes `n_rows` random rows of `dim` values in [-1, 1], in the format of
+// `data/q*.in`.
+void generate_embeddings(std::ostream& out, int n_rows, int dim, unsigned long seed);
+
+// Writes an instruction stream in the format of `data/q*_instruction.tsv`.
+// Every index is valid when its instruction runs in order: updates and
+// recommends only name users that exist by then, including the ones appended
+// by earlier inits (which are the coldest ranks). So the default streams are
+// safe for a serial run and for `Executor` or `AffinityExecutor` given the
+// number of loaded users as `first_new_row`, which hold an instruction back
+// until the init of its row has run. They are not for the server, which does
+// not order inits and rejects a user that is not there yet: set
+// `loaded_users` to only name the users that exist at load time.
+// The stream is split into `n_epochs` consecutive epochs; a recommend in
+// epoch e carries e - 1, so it sees all the updates of the epochs before.
+// Pools hold distinct items.
+void generate_instructions(std::ostream& out, const WorkloadOptions& options);
+
+} // namespace proj1
+
+#endif // THREAD_LIB_WORKLOAD_H_
@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include "workload.h"
+#include "embedding.h"
+#include "instruction.h"
+
+namespace proj1 {
+namespace testing{
+
+Instructions parse(const std::string& text) {
+    std::stringstream ss(text);
+    std::string line;
+    Instructions insts;
+    while (std::getline(ss, line)) {
+        insts.push_back(Instruction(line));
+    }
+    return insts;
+}
+
+TEST(WorkloadTest, test_zipf_skew) {
+    std::mt19937_64 rng(7);
+    ZipfSampler zipf(1000, 1.0);
+    std::vector<int> counts(1000, 0);
+    for (int i = 0; i < 100000; ++i) {
+        ++counts[zipf(rng)];
+    }
+    // 1 / H(1000) of the draws go to rank 0, about 13%
+    EXPECT_NEAR(0.134, counts[0] / 100000.0, 0.01);
+    EXPECT_GT(counts[0], 5 * counts[9]);
+    ZipfSampler uniform(10, 0.0);
+    std::vector<int> flat(10, 0);
+    for (int i = 0; i < 100000; ++i) {
+        ++flat[uniform(rng)];
+    }
+    for (int c: flat) EXPECT_NEAR(10000, c, 500);
+}
+
+TEST(WorkloadTest, test_embeddings_format) {
+    std::stringstream ss;
+    generate_embeddings(ss, 5, 16, 3);
+    std::string line;
+    int n = 0;
+    while (std::getline(ss, line)) {
+        Embedding emb(16, line);
+        for (int i = 0; i < 16; ++i) {
+            EXPECT_LE(std::abs(emb.get_data()[i]), 1.0);
+        }
+        ++n;
+    }
+    EXPECT_EQ(5, n);
+}
+
+TEST(WorkloadTest, test_stream_is_valid_and_reproducible) {
+    WorkloadOptions options;
+    options.n_instructions = 5000;
+    options.n_users = 50;
+    options.n_items = 200;
+    options.init_share = 0.1;
+    options.recommend_share = 0.1;
+    options.n_epochs = 4;
+    options.min_pool = 3;
+    options.max_pool = 8;
+    std::stringstream a, b, c;
+    generate_instructions(a, options);
+    generate_instructions(b, options);
+    options.seed = 2;
+    generate_instructions(c, options);
+    EXPECT_EQ(a.str(), b.str());
+    EXPECT_NE(a.str(), c.str());
+
+    Instructions insts = parse(a.str());
+    ASSERT_EQ(5000u, insts.size());
+    int n_users = 50;
+    int n_orders[3] = {0, 0, 0};
+    for (int i = 0; i < 5000; ++i) {
+        const Instruction& inst = insts[i];
+        int epoch = i * 4 / 5000;
+        ++n_orders[inst.order];
+        switch (inst.order) {
+            case INIT_EMB:
+                EXPECT_EQ(10u, inst.payloads.size());
+                ++n_users;
+                break;
+            case UPDATE_EMB:
+                EXPECT_LT(inst.payloads[0], n_users);
+                EXPECT_LT(inst.payloads[1], 200);
+                EXPECT_EQ(epoch, inst.epoch());
+                break;
+            case RECOMMEND:
+                EXPECT_LT(inst.payloads[0], n_users);
+                EXPECT_EQ(epoch - 1, inst.epoch());
+                EXPECT_GE(inst.payloads.size(), 5u);
+                EXPECT_LE(inst.payloads.size(), 10u);
+                break;
+        }
+    }
+    EXPECT_NEAR(500, n_orders[INIT_EMB], 100);
+    EXPECT_NEAR(4000, n_orders[UPDATE_EMB], 150);
+}
+
+TEST(WorkloadTest, test_loaded_users_only) {
+    WorkloadOptions options;
+    set_workload_option(&options, "instructions", "5000");
+    set_workload_option(&options, "users", "50");
+    set_workload_option(&options, "init", "0.3");
+    set_workload_option(&options, "loaded_users", "1");
+    std::stringstream out;
+    generate_instructions(out, options);
+    Instructions insts = parse(out.str());
+    ASSERT_EQ(5000u, insts.size());
+    int n_inits = 0;
+    for (const Instruction& inst: insts) {
+        if (inst.order == INIT_EMB)
+            ++n_inits;
+        else
+            EXPECT_LT(inst.payloads[0], 50);
+    }
+    EXPECT_LT(0, n_inits);
+}
+
+TEST(WorkloadTest, test_bad_option) {
+    WorkloadOptions options;
+    set_workload_option(&options, "user_skew", "1.2");
+    EXPECT_DOUBLE_EQ(1.2, options.user_skew);
+    EXPECT_THROW(set_workload_option(&options, "users", "ten"), std::runtime_error);
+    EXPECT_THROW(set_workload_option(&options, "colour", "1"), std::runtime_error);
+}
+
+} // namespace testing
+} // namespace proj1
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>   // string
+#include <cstring>
+#include <fstream>
+#include <iostream> // cout, endl
+#include <algorithm>
+
+// Load generator for `server`: replays an instruction file over several
+// pipelined connections and reports throughput and latency percentiles.
+//
+// Usage: loadgen [socket] [instruction file] [requests per connection]
+//                [connections] [pipeline window]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ConnectionResult {
+    std::vector<long> latency_usec;
+    long n_errors = 0;
+};
+
+int connect_to(const std::string& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+        std::cerr << "Error connecting to " << path << "!" << std::endl;
+        exit(1);
+    }
+    return fd;
+}
+
+void run_connection(const std::string& path, const std::vector<std::string>& lines,
+                    long n_requests, long window, ConnectionResult* result) {
+    int fd = connect_to(path);
+    std::deque<Clock::time_point> in_flight;
+    std::string in, out;
+    long n_sent = 0, n_done = 0;
+    char buf[64 * 1024];
+    while (n_done < n_requests) {
+        // Keep `window` requests outstanding
+        out.clear();
+        while (n_sent < n_requests && n_sent - n_done < window) {
+            out += lines[n_sent % lines.size()];
+            out += '\n';
+            in_flight.push_back(Clock::now());
+            ++n_sent;
+        }
+        for (size_t off = 0; off < out.size(); ) {
+            ssize_t n = write(fd, out.data() + off, out.size() - off);
+            if (n <= 0) {
+                std::cerr << "Connection lost!" << std::endl;
+                exit(1);
+            }
+            off += n;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            std::cerr << "Connection lost!" << std::endl;
+            exit(1);
+        }
+        in.append(buf, n);
+        size_t begin = 0, end;
+        auto now = Clock::now();
+        while ((end = in.find('\n', begin)) != std::string::npos) {
+            // Replies come back in request order
+            result->latency_usec.push_back(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - in_flight.front()).count());
+            in_flight.pop_front();
+            result->n_errors += in.compare(begin, 3, "ERR") == 0;
+            ++n_done;
+            begin = end + 1;
+        }
+        in.erase(0, begin);
+    }
+    close(fd);
+}
+
+long percentile(const std::vector<long>& sorted, double p) {
+    if (sorted.empty())  return 0;
+    size_t idx = std::min(sorted.size() - 1, (size_t) (p * sorted.size()));
+    return sorted[idx];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string path(argc > 1? argv[1]: "/tmp/proj1.sock");
+    std::string filename(argc > 2? argv[2]: "data/q4_instruction.tsv");
+    long n_requests = argc > 3? atol(argv[3]): 10000;
+    int n_connections = argc > 4? atoi(argv[4]): 4;
+    long window = argc > 5? atol(argv[5]): 64;
+
+    std::vector<std::string> lines;
+    std::ifstream ifs(filename);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (!line.empty())  lines.push_back(line);
+    }
+    if (lines.empty()) {
+        std::cerr << "No instructions in " << filename << "!" << std::endl;
+        return 1;
+    }
+
+    std::vector<ConnectionResult> results(n_connections);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < n_connections; ++i) {
+        threads.emplace_back(run_connection, path, std::cref(lines),
+                             n_requests, window, &results[i]);
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<long> all;
+    long n_errors = 0;
+    for (ConnectionResult& r: results) {
+        all.insert(all.end(), r.latency_usec.begin(), r.latency_usec.end());
+        n_errors += r.n_errors;
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << all.size() << " requests (" << n_errors << " errors) in "
+              << seconds << " s, " << (long) (all.size() / seconds) << " req/s\n"
+              << "latency usec : p50 " << percentile(all, 0.5)
+              << ", p90 " << percentile(all, 0.9)
+              << ", p99 " << percentile(all, 0.99)
+              << ", p999 " << percentile(all, 0.999)
+              << ", max " << (all.empty()? 0: all.back()) << "\n";
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include "lib/model.h" 
 #include "lib/embedding.h" 
 #include "lib/instruction.h"
+#include "lib/deterministic.h"
 
 namespace proj1 {
 
@@ -71,13 +72,21 @@ int main(int argc, char *argv[]) {
     proj1::EmbeddingHolder* users = new proj1::EmbeddingHolder("data/q0.in");
     proj1::EmbeddingHolder* items = new proj1::EmbeddingHolder("data/q0.in");
     proj1::Instructions instructions = proj1::read_instructrions("data/q0_instruction.tsv");
+    // `q0 deterministic` gives the same output, computed in parallel
+    bool deterministic = argc > 1 && std::string(argv[1]) == "deterministic";
     {
     proj1::AutoTimer timer("q0");  // using this to print out timing of the block
+    if (deterministic) {
+        proj1::DeterministicStats stats = proj1::run_deterministic(instructions, users, items);
+        std::cerr << "deterministic : " << stats.n_committed << " committed, "
+                  << stats.n_recomputed << " recomputed\n";
+    } else {
     // Run all the instructions
     for (proj1::Instruction inst: instructions) {
         proj1::run_one_instruction(inst, users, items);
     }
     }
+    }
 
     // Write the result
     users->write_to_stdout();
@@ -0,0 +1,53 @@
+#include <string>   // string
+#include <iostream> // cout, endl
+
+#include "lib/utils.h"
+#include "lib/output.h"
+#include "lib/runner.h"
+#include "lib/dot_cache.h"
+#include "lib/recommend_cache.h"
+#include "lib/affinity.h"
+#include "lib/executor.h"
+#include "lib/embedding.h"
+#include "lib/instruction.h"
+
+int main(int argc, char *argv[]) {
+
+    proj1::EmbeddingHolder* users = new proj1::EmbeddingHolder("data/q4.in");
+    proj1::EmbeddingHolder* items = new proj1::EmbeddingHolder("data/q4.in");
+    proj1::Instructions instructions = proj1::read_instructrions("data/q4_instruction.tsv");
+    {
+    proj1::AutoTimer timer("q4");  // using this to print out timing of the block
+    proj1::OutputChannel output;
+    proj1::DotCache dots;
+    proj1::RecommendCache results;
+    auto handler = [users, items, &output, &dots, &results] (const proj1::Instruction& inst) {
+        proj1::run_instruction(inst, users, items, &output, &dots, &results);
+    };
+    if (argc > 1 && std::string(argv[1]) == "affinity") {
+        // Keep each user's instructions on one (pinned) core
+        proj1::AffinityOptions options;
+        options.pin_workers = true;
+        options.first_new_row = users->get_n_embeddings();
+        proj1::AffinityExecutor executor(handler, options);
+        executor.run(instructions);
+        executor.report();
+    } else {
+        // Recommends get their own lane, updates yield to them
+        proj1::ExecutorOptions options;
+        options.first_new_row = users->get_n_embeddings();
+        proj1::Executor executor(handler, options);
+        executor.run(instructions);
+        executor.report();
+    }
+    output.flush();
+    output.report();
+    dots.report();
+    results.report();
+    }
+
+    delete users;
+    delete items;
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <csignal>
+#include <pthread.h>
+#include <thread>
+#include <string>   // string
+#include <iostream> // cout, endl
+
+#include "lib/utils.h"
+#include "lib/server.h"
+#include "lib/shm_table.h"
+
+namespace {
+
+proj1::Server* server = nullptr;
+
+// Parses a snapshot into its own generation of shared memory segments
+proj1::ServingTables* load_tables(const std::string& user_file,
+                                  const std::string& item_file, int generation) {
+    std::string suffix = "_" + std::to_string(generation);
+    proj1::SharedTable* user_table = proj1::SharedTable::create("/proj1_users" + suffix, user_file);
+    proj1::SharedTable* item_table = proj1::SharedTable::create("/proj1_items" + suffix, item_file);
+    return new proj1::ServingTables(user_table->make_holder(), item_table->make_holder(),
+                                    {user_table, item_table});
+}
+
+} // namespace
+
+// Usage: server [socket] [user file] [item file]
+// SIGHUP reloads both files in the background and swaps them in, SIGINT or
+// SIGTERM stops the server.
+int main(int argc, char *argv[]) {
+    std::string socket_path(argc > 1? argv[1]: "/tmp/proj1.sock");
+    std::string user_file(argc > 2? argv[2]: "data/q4.in");
+    std::string item_file(argc > 3? argv[3]: "data/q4.in");
+
+    // Every thread leaves the signals to the signal thread below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Parse the holders once, every request is served from shared memory
+    server = new proj1::Server(socket_path, load_tables(user_file, item_file, 0));
+    std::thread signal_thread([&] {
+        int generation = 0, sig;
+        while (sigwait(&signals, &sig) == 0 && sig == SIGHUP) {
+            try {
+                server->swap(load_tables(user_file, item_file, ++generation));
+                std::cout << "swapped in generation " << generation << std::endl;
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+        server->stop();
+    });
+    {
+    proj1::AutoTimer timer("server");
+    std::cout << "serving on " << socket_path << std::endl;
+    server->serve();
+    }
+    signal_thread.join();
+    delete server;
+
+    return 0;
+}
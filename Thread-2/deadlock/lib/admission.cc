@@ -0,0 +1,122 @@
+#include <algorithm>
+#include "admission.h"
+
+namespace proj2 {
+
+AdmissionScheduler::AdmissionScheduler(ThreadManager* tmgr, std::map<RESOURCE, int> total):
+        tmgr(tmgr), total(), free(), started(false), n_admitted(0), n_running(0),
+        max_running(0) {
+    for (auto& entry: total) {
+        this->total[entry.first] = entry.second;
+    }
+    this->free = this->total;
+}
+
+bool AdmissionScheduler::add(const std::map<RESOURCE, int>& claim, std::function<void()> fn) {
+    ResourceVector amounts = {};
+    for (auto& entry: claim) {
+        if (entry.second > 0)
+            amounts[entry.first] += entry.second;
+    }
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (amounts[r] > this->total[r])
+            return false;
+    }
+    std::lock_guard<std::mutex> lk(this->mutex);
+    auto found = this->groups.find(amounts);
+    if (found == this->groups.end()) {
+        Group group;
+        group.claim = amounts;
+        group.share = 0;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            if (amounts[r] > 0)
+                group.share = std::max(group.share, (double) amounts[r] / this->total[r]);
+        }
+        found = this->groups.emplace(amounts, std::move(group)).first;
+        Group* added = &found->second;
+        // After the groups of the same share, so that ties go in order
+        this->order.insert(std::upper_bound(
+            this->order.begin(), this->order.end(), added,
+            [] (const Group* a, const Group* b) { return a->share < b->share; }), added);
+    }
+    Job job;
+    job.fn = std::move(fn);
+    job.since = this->n_admitted;
+    found->second.jobs.push_back(std::move(job));
+    if (this->started)
+        this->admit();
+    return true;
+}
+
+void AdmissionScheduler::start() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    this->started = true;
+    this->admit();
+}
+
+int AdmissionScheduler::get_max_running() {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    return this->max_running;
+}
+
+void AdmissionScheduler::admit() {
+    while (true) {
+        // The one that waited too long goes first, and alone
+        Group* next = nullptr;
+        for (Group* group: this->order) {
+            if (group->jobs.empty() || this->n_admitted - group->jobs.front().since < kAgingLimit)
+                continue;
+            if (next == nullptr || group->jobs.front().since < next->jobs.front().since)
+                next = group;
+        }
+        bool fits = false;
+        if (next != nullptr) {
+            fits = std::equal(next->claim.begin(), next->claim.end(), this->free.begin(),
+                              [] (int claim, int free) { return claim <= free; });
+        } else {
+            for (Group* group: this->order) {
+                if (group->jobs.empty())
+                    continue;
+                fits = std::equal(group->claim.begin(), group->claim.end(), this->free.begin(),
+                                  [] (int claim, int free) { return claim <= free; });
+                if (fits) {
+                    next = group;
+                    break;
+                }
+            }
+        }
+        // Only what fits, so that `free` never goes below zero
+        if (next == nullptr || !fits)
+            return;
+
+        Job job = std::move(next->jobs.front());
+        next->jobs.pop_front();
+        ++this->n_admitted;
+        if (!next->jobs.empty())
+            next->jobs.front().since = this->n_admitted;
+        ResourceVector claim = next->claim;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            this->free[r] -= claim[r];
+        }
+        this->max_running = std::max(this->max_running, ++this->n_running);
+        std::function<void()> fn = std::move(job.fn);
+        this->tmgr->new_task([this, fn, claim] {
+            fn();
+            // A killed run is rerun with the same claim, which stays taken
+            CancelToken* token = current_cancel_token();
+            if (token == nullptr || !token->is_cancelled())
+                this->finished(claim);
+        });
+    }
+}
+
+void AdmissionScheduler::finished(const ResourceVector& claim) {
+    std::lock_guard<std::mutex> lk(this->mutex);
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        this->free[r] += claim[r];
+    }
+    --this->n_running;
+    this->admit();
+}
+
+} // namespace: proj2
@@ -0,0 +1,71 @@
+#ifndef DEADLOCK_LIB_ADMISSION_H_
+#define DEADLOCK_LIB_ADMISSION_H_
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include "thread_manager.h"
+#include "resource_manager.h"
+
+namespace proj2 {
+
+// Waiting this many admissions of other tasks, a task is served before any
+// smaller one: it is admitted first once its claim fits, and nothing else
+// is admitted until then
+const int kAgingLimit = 64;
+
+// Starts tasks on a ThreadManager only while their budget claims fit
+// together in the resources, so that admitted tasks never wait for each
+// other. The smallest claims go first, by their dominant share of a
+// resource, which packs the most tasks at once; aging keeps the large ones
+// from starving behind them.
+class AdmissionScheduler {
+public:
+    AdmissionScheduler(ThreadManager* tmgr, std::map<RESOURCE, int> total);
+    // The task claims `claim` through the resource manager when it starts.
+    // A claim of more than there is could never be admitted: it is rejected,
+    // and the task never runs.
+    template <class Fn, class... Args>
+    bool submit(std::map<RESOURCE, int> claim, Fn&& fn, Args&&... args);
+    // Admits the first tasks, submitted before so that they are ordered;
+    // the rest start as running ones finish
+    void start();
+    int get_max_running();
+private:
+    struct Job {
+        std::function<void()> fn;
+        long since;  // the admissions count when it got first in its group
+    };
+    // The tasks with the same claim, in the order they came
+    struct Group {
+        ResourceVector claim;
+        double share;  // the largest fraction of a resource it claims
+        std::deque<Job> jobs;
+    };
+
+    bool add(const std::map<RESOURCE, int>& claim, std::function<void()> fn);
+    void admit();
+    void finished(const ResourceVector& claim);
+
+    ThreadManager* tmgr;
+    ResourceVector total;
+    std::mutex mutex;
+    ResourceVector free;  // not claimed by an admitted task, never negative
+    std::map<ResourceVector, Group> groups;
+    std::vector<Group*> order;  // by share
+    bool started;
+    long n_admitted;
+    int n_running;
+    int max_running;
+};
+
+template <class Fn, class... Args>
+bool AdmissionScheduler::submit(std::map<RESOURCE, int> claim, Fn&& fn, Args&&... args) {
+    return this->add(claim, [fn, args...] { (fn)(args...); });
+}
+
+}  // namespce: proj2
+
+#endif
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "thread_manager.h"
+#include "admission.h"
+
+namespace proj2 {
+namespace testing{
+
+std::map<RESOURCE, int> budget(int amount) {
+    return {{GPU, amount}, {MEMORY, amount}, {DISK, amount}, {NETWORK, amount}};
+}
+
+void sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TEST(AdmissionTest, test_claims_never_exceed_total) {
+    ThreadManager tmgr;
+    AdmissionScheduler scheduler(&tmgr, budget(10));
+    std::mutex mutex;
+    std::vector<int> used(N_RESOURCES);
+    bool exceeded = false;
+    std::atomic<int> n_done(0);
+    for (int i = 0; i < 200; ++i) {
+        RESOURCE r1 = RESOURCE(i % 4), r2 = RESOURCE((i + 1) % 4);
+        int a1 = 1 + i % 7, a2 = 1 + i * 3 % 5;
+        scheduler.submit({{r1, a1}, {r2, a2}}, [&, r1, r2, a1, a2] {
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                used[r1] += a1;
+                used[r2] += a2;
+                exceeded = exceeded || used[r1] > 10 || used[r2] > 10;
+            }
+            sleep_ms(1);
+            std::lock_guard<std::mutex> lk(mutex);
+            used[r1] -= a1;
+            used[r2] -= a2;
+            ++n_done;
+        });
+    }
+    scheduler.start();
+    tmgr.wait();
+    EXPECT_EQ(200, n_done);
+    EXPECT_FALSE(exceeded);
+    EXPECT_GT(scheduler.get_max_running(), 1);
+}
+
+TEST(AdmissionTest, test_smallest_first) {
+    ThreadManager tmgr;
+    AdmissionScheduler scheduler(&tmgr, budget(10));
+    std::mutex mutex;
+    std::vector<int> started;
+    for (int amount: {9, 6, 1, 3}) {
+        scheduler.submit({{GPU, amount}}, [&, amount] {
+            std::lock_guard<std::mutex> lk(mutex);
+            started.push_back(amount);
+        });
+    }
+    scheduler.start();
+    tmgr.wait();
+    // 1, 3 and 6 fit at once, 9 waits for them
+    ASSERT_EQ(4u, started.size());
+    EXPECT_EQ(9, started.back());
+}
+
+TEST(AdmissionTest, test_large_claim_is_not_starved) {
+    ThreadManager tmgr;
+    AdmissionScheduler scheduler(&tmgr, budget(10));
+    std::atomic<int> n_small(0), n_small_before_large(-1);
+    scheduler.submit({{GPU, 10}}, [&] { n_small_before_large = n_small.load(); });
+    // Small tasks keep coming from the running ones, so GPU is never free
+    std::function<void(int)> small = [&] (int depth) {
+        ++n_small;
+        sleep_ms(1);
+        if (depth < 20)
+            scheduler.submit({{GPU, 2}}, small, depth + 1);
+    };
+    for (int i = 0; i < 5; ++i) {
+        scheduler.submit({{GPU, 2}}, small, 0);
+    }
+    scheduler.start();
+    tmgr.wait();
+    EXPECT_EQ(105, n_small);
+    EXPECT_GE(n_small_before_large, 0);
+    EXPECT_LT(n_small_before_large, 105);
+}
+
+TEST(AdmissionTest, test_claim_over_total_is_rejected) {
+    ThreadManager tmgr;
+    AdmissionScheduler scheduler(&tmgr, budget(10));
+    std::atomic<int> n_done(0);
+    EXPECT_FALSE(scheduler.submit({{DISK, 11}}, [&] { ++n_done; }));
+    // Nothing of it was taken: two halves still run together
+    EXPECT_TRUE(scheduler.submit({{DISK, 5}}, [&] { ++n_done; sleep_ms(20); }));
+    EXPECT_TRUE(scheduler.submit({{DISK, 5}}, [&] { ++n_done; sleep_ms(20); }));
+    scheduler.start();
+    tmgr.wait();
+    EXPECT_EQ(2, n_done);
+    EXPECT_EQ(2, scheduler.get_max_running());
+}
+
+} // namespace testing
+} // namespace proj2
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include "lock_profile.h"
+
+namespace proj2 {
+
+namespace {
+
+using LockId = std::pair<std::string, int>;
+
+// Never freed, so that the report at exit can still use it
+struct Registry {
+    std::mutex mutex;
+    std::set<ProfiledMutex*> live;
+    std::map<LockId, LockStats> retired;  // of the destroyed mutexes
+};
+
+void report_at_exit() {
+    report_lock_profile(std::cerr);
+}
+
+Registry& registry() {
+    static Registry* registry = [] {
+        std::atexit(report_at_exit);
+        return new Registry();
+    }();
+    return *registry;
+}
+
+void add(LockStats* total, const LockStats& s) {
+    total->n_acquired += s.n_acquired;
+    total->n_contended += s.n_contended;
+    total->n_failed_tries += s.n_failed_tries;
+    total->wait_nsec += s.wait_nsec;
+    total->hold_nsec += s.hold_nsec;
+}
+
+} // namespace
+
+ProfiledMutex::ProfiledMutex(const char* name, int index) :
+        name(name),
+        index(index),
+        held_since(0),
+        n_acquired(0),
+        n_contended(0),
+        n_failed_tries(0),
+        wait_nsec(0),
+        hold_nsec(0) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mutex);
+    r.live.insert(this);
+}
+
+ProfiledMutex::~ProfiledMutex() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mutex);
+    r.live.erase(this);
+    if (this->n_acquired.load() > 0 || this->n_failed_tries.load() > 0) {
+        LockStats& retired = r.retired[LockId(this->name, this->index)];
+        add(&retired, this->get_stats());
+    }
+}
+
+LockStats ProfiledMutex::get_stats() const {
+    LockStats stats;
+    stats.n_acquired = this->n_acquired.load();
+    stats.n_contended = this->n_contended.load();
+    stats.n_failed_tries = this->n_failed_tries.load();
+    stats.wait_nsec = this->wait_nsec.load();
+    stats.hold_nsec = this->hold_nsec.load();
+    return stats;
+}
+
+void report_lock_profile(std::ostream& os, int top) {
+    Registry& r = registry();
+    std::map<LockId, LockStats> by_id;
+    {
+        std::lock_guard<std::mutex> lk(r.mutex);
+        by_id = r.retired;
+        for (ProfiledMutex* mutex: r.live) {
+            LockStats s = mutex->get_stats();
+            if (s.n_acquired > 0 || s.n_failed_tries > 0)
+                add(&by_id[LockId(mutex->get_name(), mutex->get_index())], s);
+        }
+    }
+    if (by_id.empty())
+        return;
+    LockStats total = {0, 0, 0, 0, 0};
+    std::vector<std::pair<LockId, LockStats> > sorted(by_id.begin(), by_id.end());
+    for (auto& entry: sorted) {
+        add(&total, entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [] (const std::pair<LockId, LockStats>& a,
+                                                const std::pair<LockId, LockStats>& b) {
+        return a.second.wait_nsec > b.second.wait_nsec;
+    });
+    os << "locks : " << total.n_acquired << " acquired, " << total.n_contended
+       << " contended, " << total.n_failed_tries << " failed tries, "
+       << total.wait_nsec / 1000 << " usec waiting, " << total.hold_nsec / 1000
+       << " usec held\n";
+    for (int i = 0; i < top && i < (int) sorted.size(); ++i) {
+        const LockId& id = sorted[i].first;
+        const LockStats& s = sorted[i].second;
+        os << "  " << id.first;
+        if (id.second >= 0)
+            os << '[' << id.second << ']';
+        os << " : " << s.n_acquired << " acquired, " << s.n_contended << " contended, "
+           << s.wait_nsec / 1000 << " usec waiting (avg "
+           << (s.n_contended == 0? 0: s.wait_nsec / s.n_contended / 1000)
+           << "), " << s.hold_nsec / 1000 << " usec held\n";
+    }
+}
+
+} // namespace proj2
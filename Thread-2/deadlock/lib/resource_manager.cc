@@ -1,48 +1,694 @@
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <stdexcept>
 #include <condition_variable>
 #include "resource_manager.h"
 
 namespace proj2 {
 
-int ResourceManager::request(RESOURCE r, int amount) {
-    if (amount <= 0)  return 1;
+namespace {
 
-    std::unique_lock<std::mutex> lk(this->resource_mutex[r]);
-    while (true) {
-        if (this->resource_cv[r].wait_for(
-            lk, std::chrono::milliseconds(100),
-            [this, r, amount] { return this->resource_amount[r] >= amount; }
-        )) {
-            break;
-        } else {
-            auto this_id = std::this_thread::get_id();
-            /* HINT: If you choose to detect the deadlock and recover,
-                     implement your code here to kill and restart threads.
-                     Note that you should release this thread's resources
-                     properly.
-             */
-            if (tmgr->is_killed(this_id)) {
-                return -1;
+bool fits(const ResourceVector& need, const ResourceVector& work) {
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (need[r] > work[r])
+            return false;
+    }
+    return true;
+}
+
+int units_of(PackedResources packed, int r) {
+    return (packed >> (r * kUnitBits)) & kMaxUnits;
+}
+
+PackedResources pack(const ResourceVector& amounts) {
+    PackedResources packed = 0;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        packed |= (PackedResources) amounts[r] << (r * kUnitBits);
+    }
+    return packed;
+}
+
+} // namespace
+
+ResourceManager::ResourceManager(ThreadManager *t, std::map<RESOURCE, int> init_count,
+                                 ResourcePolicy policy): \
+        policy(policy), total(), n_waiters(0), n_requests(0), killing(std::thread::id()),
+        stats(), tmgr(t) {
+    for (auto& entry: init_count) {
+        if (entry.second < 0 || entry.second > kMaxUnits)
+            throw std::runtime_error("Bad resource amount!");
+        this->total[entry.first] = entry.second;
+    }
+    this->free_units.store(pack(this->total));
+    set_lock_name(this->mutex, "resource manager");
+    if (t != nullptr) {
+        t->on_exit([this] (TaskId id) { this->task_exited(id); });
+        t->on_kill([this] (TaskId id) { this->task_killed(id); });
+    }
+}
+
+bool ResourceManager::try_take(const ResourceVector& amounts) {
+    PackedResources wanted = pack(amounts);
+    PackedResources old = this->free_units.load();
+    do {
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            if (units_of(old, r) < amounts[r])
+                return false;
+        }
+        // No field goes below zero, so no borrow crosses fields
+    } while (!this->free_units.compare_exchange_weak(old, old - wanted));
+    return true;
+}
+
+void ResourceManager::give(const ResourceVector& amounts) {
+    // Capped at the total, so that releasing too much cannot carry over
+    PackedResources old = this->free_units.load(), units;
+    do {
+        ResourceVector free;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            free[r] = std::min(units_of(old, r) + amounts[r], this->total[r]);
+        }
+        units = pack(free);
+    } while (!this->free_units.compare_exchange_weak(old, units));
+}
+
+ResourceVector ResourceManager::get_available() const {
+    PackedResources packed = this->free_units.load();
+    ResourceVector available;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        available[r] = units_of(packed, r);
+    }
+    return available;
+}
+
+ResourceManager::Task& ResourceManager::task_of(TaskId id) {
+    auto found = this->tasks.find(id);
+    if (found != this->tasks.end())
+        return found->second;
+    Task& task = this->tasks.emplace(id, Task(id)).first->second;
+    // Claiming nothing yet, it can finish last
+    this->safe_order.push_back(&task);
+    return task;
+}
+
+bool ResourceManager::order_is_safe(const std::vector<Task*>& order) {
+    ResourceVector work = this->get_available();
+    for (Task* task: order) {
+        ResourceVector need;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            need[r] = task->claim[r] - task->held[r];
+        }
+        if (!fits(need, work))
+            return false;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            work[r] += task->held[r];
+        }
+    }
+    return true;
+}
+
+bool ResourceManager::is_safe() {
+    if (this->order_is_safe(this->safe_order))
+        return true;
+    // The banker's search for another order, kept if there is one
+    std::vector<Task*> pending = this->safe_order, order;
+    ResourceVector work = this->get_available();
+    bool progress = true;
+    while (!pending.empty() && progress) {
+        progress = false;
+        std::vector<Task*> blocked;
+        for (Task* task: pending) {
+            ResourceVector need;
+            for (int r = 0; r < N_RESOURCES; ++r) {
+                need[r] = task->claim[r] - task->held[r];
+            }
+            if (!fits(need, work)) {
+                blocked.push_back(task);
+                continue;
+            }
+            for (int r = 0; r < N_RESOURCES; ++r) {
+                work[r] += task->held[r];
+            }
+            order.push_back(task);
+            progress = true;
+        }
+        pending.swap(blocked);
+    }
+    if (!pending.empty())
+        return false;
+    this->safe_order.swap(order);
+    return true;
+}
+
+bool ResourceManager::try_grant(Task& task, const ResourceVector& amounts) {
+    if (!this->try_take(amounts))
+        return false;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        task.held[r] += amounts[r];
+    }
+    if (this->policy == AVOIDANCE && !this->is_safe()) {
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            task.held[r] -= amounts[r];
+        }
+        this->give(amounts);
+        return false;
+    }
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (amounts[r] > 0)
+            this->holders[r].insert(&task);
+    }
+    return true;
+}
+
+void ResourceManager::add_waiter(Waiter* waiter) {
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (waiter->amounts[r] > 0)
+            waiter->places[r] = this->waiters[r].insert(this->waiters[r].end(), waiter);
+    }
+    ++this->n_waiters;
+}
+
+void ResourceManager::remove_waiter(Waiter* waiter) {
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (waiter->amounts[r] > 0)
+            this->waiters[r].erase(waiter->places[r]);
+    }
+    --this->n_waiters;
+}
+
+double ResourceManager::dominant_share(const Task& task) const {
+    double share = 0;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (this->total[r] > 0)
+            share = std::max(share, (double) task.held[r] / this->total[r]);
+    }
+    return share / task.weight;
+}
+
+bool ResourceManager::ranks_before(const Waiter* waiter, const Task& task) const {
+    // GREEDY keeps no tasks, its waiters go in the order they came
+    if (waiter->task == nullptr)
+        return false;
+    if (waiter->priority != task.priority)
+        return waiter->priority > task.priority;
+    return this->dominant_share(*waiter->task) <= this->dominant_share(task);
+}
+
+// A task holding nothing cannot be waited for, so making it wait behind a
+// waiter ranked before it never closes a deadlock
+bool ResourceManager::yields_to_waiter(const Task& task, const ResourceVector& amounts) const {
+    if (!fits(task.held, ResourceVector()))
+        return false;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (amounts[r] == 0)
+            continue;
+        for (const Waiter* w: this->waiters[r]) {
+            if (w->task != &task && this->ranks_before(w, task))
+                return true;
+        }
+    }
+    return false;
+}
+
+void ResourceManager::overtake_waiters(const ResourceVector& amounts, const Waiter* granted) {
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (amounts[r] == 0)
+            continue;
+        for (Waiter* w: this->waiters[r]) {
+            if (w != granted)
+                ++w->overtaken;
+        }
+    }
+}
+
+void ResourceManager::wake_waiters(const ResourceVector& freed) {
+    // Under AVOIDANCE, any release may make a waiting request safe
+    std::vector<Waiter*> ranked;
+    ResourceVector ranked_by = {};  // the queues looked at
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (freed[r] == 0 && this->policy != AVOIDANCE)
+            continue;
+        ranked_by[r] = 1;
+        ranked.insert(ranked.end(), this->waiters[r].begin(), this->waiters[r].end());
+    }
+    if (ranked.empty())
+        return;
+    std::sort(ranked.begin(), ranked.end());
+    ranked.erase(std::unique(ranked.begin(), ranked.end()), ranked.end());
+    // The shares are those before any grant, so that one pass is enough
+    std::vector<std::pair<Waiter*, double> > shares;
+    for (Waiter* w: ranked) {
+        shares.push_back({w, w->task != nullptr? this->dominant_share(*w->task): 0});
+    }
+    std::sort(shares.begin(), shares.end(),
+        [] (const std::pair<Waiter*, double>& a, const std::pair<Waiter*, double>& b) {
+            if (a.first->priority != b.first->priority)
+                return a.first->priority > b.first->priority;
+            if (a.second != b.second)
+                return a.second < b.second;
+            return a.first->seq < b.first->seq;
+        });
+
+    // What the waiters ranked first still wait for, not to be given to the
+    // tasks that yield to them
+    ResourceVector wanted = {};
+    // The queues of what is granted, where a task may have yielded to it
+    ResourceVector rescan = {};
+    bool any_rescan = false;
+    for (auto& entry: shares) {
+        Waiter* w = entry.first;
+        bool yields = false;
+        if (w->task != nullptr && fits(w->task->held, ResourceVector())) {
+            for (int r = 0; r < N_RESOURCES; ++r) {
+                yields = yields || (w->amounts[r] > 0 && wanted[r] > 0);
             }
         }
+        bool granted = !yields && (w->task != nullptr?
+            this->try_grant(*w->task, w->amounts): this->try_take(w->amounts));
+        if (!granted) {
+            for (int r = 0; r < N_RESOURCES; ++r) {
+                wanted[r] += w->amounts[r];
+            }
+            continue;
+        }
+        if (w->task != nullptr)
+            w->task->waiting = nullptr;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            if (w->amounts[r] > 0 && ranked_by[r] == 0 && w->task != nullptr) {
+                rescan[r] = 1;
+                any_rescan = true;
+            }
+        }
+        this->remove_waiter(w);
+        this->overtake_waiters(w->amounts, w);
+        w->granted = true;
+        w->cv.notify_one();
+    }
+    if (any_rescan)
+        this->wake_waiters(rescan);
+}
+
+void ResourceManager::count_wait(const Waiter& waiter) {
+    long usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - waiter.since).count();
+    WaitStats& stats = this->stats.waits[waiter.priority];
+    ++stats.n_waits;
+    stats.total_wait += usec;
+    stats.max_wait = std::max(stats.max_wait, usec);
+    stats.max_overtaken = std::max(stats.max_overtaken, waiter.overtaken);
+}
+
+int ResourceManager::budget_claim(std::map<RESOURCE, int> budget, int priority,
+                                  double weight) {
+    // This function is called when some workload starts.
+    // The workload will eventually consume all resources it claims
+    if (weight <= 0)
+        return -1;
+    // Checked before anything changes, so a rejected claim leaves no trace
+    for (auto& entry: budget) {
+        if (entry.second > this->total[entry.first])
+            return -1;
+    }
+    if (this->policy == GREEDY)
+        return 0;
+    std::unique_lock<Mutex> lk(this->mutex);
+    Task& task = this->task_of(current_task());
+    task.priority = priority;
+    task.weight = weight;
+    for (auto& entry: budget) {
+        task.claim[entry.first] = std::max(entry.second, task.held[entry.first]);
     }
-    this->resource_amount[r] -= amount;
-    this->resource_mutex[r].unlock();
     return 0;
 }
 
+int ResourceManager::request(RESOURCE r, int amount) {
+    if (amount <= 0)  return 1;
+    ResourceVector amounts = {};
+    amounts[r] = amount;
+    return this->acquire(amounts);
+}
+
+int ResourceManager::request_all(std::map<RESOURCE, int> amounts) {
+    ResourceVector wanted = {};
+    bool any = false;
+    for (auto& entry: amounts) {
+        if (entry.second <= 0)  continue;
+        wanted[entry.first] += entry.second;
+        any = true;
+    }
+    if (!any)  return 1;
+    // Before anything is packed: a word only holds amounts up to the totals
+    if (!fits(wanted, this->total))
+        return -1;
+    return this->acquire(wanted);
+}
+
+int ResourceManager::acquire(const ResourceVector& amounts) {
+    if (!fits(amounts, this->total))
+        return -1;
+    // A cancellation point, also when it would not have to wait
+    CancelToken* token = current_cancel_token();
+    if (token != nullptr && token->is_cancelled())
+        return -1;
+    if (this->policy == GREEDY)
+        return this->acquire_greedy(amounts);
+
+    std::unique_lock<Mutex> lk(this->mutex);
+    // Again under the lock: a kill since the check above found nothing to
+    // reclaim, and the task must not get a fresh entry to hold things with.
+    // A kill from now on finds it, under this lock.
+    if (token != nullptr && token->is_cancelled())
+        return -1;
+    Task& task = this->task_of(current_task());
+    // Going over the claim raises it, which is only safe if it still checks
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        task.claim[r] = std::max(task.claim[r], task.held[r] + amounts[r]);
+    }
+    if (!this->yields_to_waiter(task, amounts) && this->try_grant(task, amounts)) {
+        this->overtake_waiters(amounts, nullptr);
+        return 0;
+    }
+
+    Waiter waiter(&task, amounts, ++this->n_requests);
+    this->add_waiter(&waiter);
+    task.waiting = &waiter;
+    // Queued first, so that what the victims free goes by rank to it
+    this->preempt_for(task, amounts);
+    if (this->policy == DETECTION)
+        this->detect_deadlock({task.id});
+    // Or killed, its task and holdings are gone already
+    return this->wait_for_grant(waiter, lk);
+}
+
+int ResourceManager::acquire_greedy(const ResourceVector& amounts) {
+    if (this->try_take(amounts))
+        return 0;
+    std::unique_lock<Mutex> lk(this->mutex);
+    Waiter waiter(nullptr, amounts, ++this->n_requests);
+    // Counted as a waiter before trying again: a release either sees it,
+    // or happened before and is seen by the try
+    this->add_waiter(&waiter);
+    if (this->try_take(amounts)) {
+        this->remove_waiter(&waiter);
+        return 0;
+    }
+    return this->wait_for_grant(waiter, lk);
+}
+
+// -1 if the task is killed before it is granted
+int ResourceManager::wait_for_grant(Waiter& waiter, std::unique_lock<Mutex>& lk) {
+    // From now on a kill finds the waiter through `task_killed`, and a
+    // release grants it directly: nothing has to be polled
+    CancelToken* token = current_cancel_token();
+    if (!waiter.killed && token != nullptr && token->is_cancelled())
+        this->drop_killed(waiter.id);
+    waiter.cv.wait(lk, [&waiter] { return waiter.granted || waiter.killed; });
+    this->count_wait(waiter);
+    return waiter.granted? 0: -1;
+}
+
 void ResourceManager::release(RESOURCE r, int amount) {
     if (amount <= 0)  return;
-    std::unique_lock<std::mutex> lk(this->resource_mutex[r]);
-    this->resource_amount[r] += amount;
-    this->resource_cv[r].notify_all();
+    ResourceVector amounts = {};
+    amounts[r] = amount;
+    if (this->policy == GREEDY) {
+        this->give(amounts);
+        if (this->n_waiters.load() > 0) {
+            std::unique_lock<Mutex> lk(this->mutex);
+            this->wake_waiters(amounts);
+        }
+        return;
+    }
+    std::unique_lock<Mutex> lk(this->mutex);
+    // None when it holds nothing, e.g. killed and reclaimed already
+    auto found = this->tasks.find(current_task());
+    if (found == this->tasks.end())
+        return;
+    Task& task = found->second;
+    amounts[r] = std::min(amount, task.held[r]);
+    this->give(amounts);
+    task.held[r] -= amounts[r];
+    bool left = task.held[r] == 0;
+    if (left)
+        this->holders[r].erase(&task);
+    this->wake_waiters(amounts);
+    if (left)
+        this->recheck_waiters(amounts);
 }
 
-void ResourceManager::budget_claim(std::map<RESOURCE, int> budget) {
-    // This function is called when some workload starts.
-    // The workload will eventually consume all resources it claims
+void ResourceManager::detect_deadlock(std::vector<TaskId> roots) {
+    // Killing one victim may not free enough, the rest is checked again
+    while (!roots.empty()) {
+        auto found = this->tasks.find(roots.back());
+        roots.pop_back();
+        if (found == this->tasks.end() || found->second.waiting == nullptr)
+            continue;
+        // Everything the root waits for, directly or not. If one of them
+        // runs it will release or block in turn, when we look again.
+        std::vector<Task*> stack = {&found->second}, candidates;
+        std::unordered_set<Task*> seen = {&found->second};
+        bool running = false;
+        while (!stack.empty() && !running) {
+            Task* task = stack.back();
+            stack.pop_back();
+            if (task->waiting == nullptr) {
+                running = true;
+                break;
+            }
+            for (int r = 0; r < N_RESOURCES; ++r) {
+                if (task->waiting->amounts[r] == 0)
+                    continue;
+                for (Task* holder: this->holders[r]) {
+                    if (seen.insert(holder).second)
+                        stack.push_back(holder);
+                    candidates.push_back(holder);
+                }
+            }
+        }
+        // Nobody holds what it waits for: it yields to a waiter ranked
+        // before it, and that one is checked on its own
+        if (running || candidates.empty())
+            continue;
+
+        // Deadlocked: the victim is the holder that loses the least work
+        auto now = std::chrono::steady_clock::now();
+        Task* victim = nullptr;
+        long victim_cost = 0;
+        for (Task* task: candidates) {
+            long cost = this->work_lost(*task, now);
+            if (victim == nullptr || cost < victim_cost) {
+                victim = task;
+                victim_cost = cost;
+            }
+        }
+        ++this->stats.n_deadlocks;
+        this->stats.lost_work += victim_cost / 1000;
+        for (Task* task: seen) {
+            if (task != victim)
+                roots.push_back(task->id);
+        }
+        this->kill_victim(victim);
+    }
+    if (this->tasks.empty())
+        this->rerun_victims();
+}
+
+// In resource units x usec
+long ResourceManager::work_lost(const Task& task, std::chrono::steady_clock::time_point now) {
+    long units = 0;
+    for (int held: task.held) {
+        units += held;
+    }
+    // Only the work since its last checkpoint is redone
+    auto since = task.start;
+    if (this->tmgr != nullptr)
+        since = std::max(since, this->tmgr->progress_since(task.id));
+    long usec = std::chrono::duration_cast<std::chrono::microseconds>(now - since).count();
+    return units * std::max(usec, 1L);
+}
+
+void ResourceManager::preempt_for(const Task& task, const ResourceVector& amounts) {
+    if (this->tmgr == nullptr)
+        return;
+    // What is missing; under AVOIDANCE it may also wait for a safe order,
+    // which no preemption is sure to give
+    ResourceVector missing = this->get_available();
+    bool lacks = false;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        missing[r] = std::max(amounts[r] - missing[r], 0);
+        lacks = lacks || missing[r] > 0;
+    }
+    if (!lacks)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<Task*, long> > candidates;
+    std::unordered_set<Task*> seen;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (missing[r] == 0)
+            continue;
+        for (Task* holder: this->holders[r]) {
+            if (holder->priority >= task.priority || !seen.insert(holder).second)
+                continue;
+            auto found = this->n_preempted.find(holder->id);
+            if (found != this->n_preempted.end() && found->second >= kMaxPreemptions)
+                continue;
+            candidates.push_back({holder, this->work_lost(*holder, now)});
+        }
+    }
+    // The lowest priority first, then the least work lost
+    std::sort(candidates.begin(), candidates.end(),
+        [] (const std::pair<Task*, long>& a, const std::pair<Task*, long>& b) {
+            if (a.first->priority != b.first->priority)
+                return a.first->priority < b.first->priority;
+            return a.second < b.second;
+        });
+    std::vector<std::pair<Task*, long> > chosen;
+    for (auto& entry: candidates) {
+        bool useful = false;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            useful = useful || (missing[r] > 0 && entry.first->held[r] > 0);
+        }
+        if (!useful)
+            continue;
+        chosen.push_back(entry);
+        lacks = false;
+        for (int r = 0; r < N_RESOURCES; ++r) {
+            missing[r] = std::max(missing[r] - entry.first->held[r], 0);
+            lacks = lacks || missing[r] > 0;
+        }
+        if (!lacks)
+            break;
+    }
+    // Killing only some of them would not be enough
+    if (lacks)
+        return;
+    for (auto& entry: chosen) {
+        ++this->n_preempted[entry.first->id];
+        ++this->stats.n_preemptions;
+        this->stats.preempted_work += entry.second / 1000;
+        this->kill_victim(entry.first);
+    }
+}
+
+void ResourceManager::kill_victim(Task* victim) {
+    TaskId id = victim->id;
+    ResourceVector freed = this->reclaim(victim);
+    if (this->tmgr != nullptr) {
+        this->killing.store(std::this_thread::get_id());
+        this->tmgr->kill(id);
+        this->killing.store(std::thread::id());
+        this->victims.push_back(id);
+    }
+    this->wake_waiters(freed);
+}
+
+// A deadlock also closes when a running holder leaves without blocking, and
+// the waiters it leaves behind cannot be granted from what it gave back
+void ResourceManager::recheck_waiters(const ResourceVector& left) {
+    if (this->policy != DETECTION)
+        return;
+    std::vector<TaskId> roots;
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        if (left[r] == 0)
+            continue;
+        for (Waiter* w: this->waiters[r]) {
+            roots.push_back(w->task->id);
+        }
+    }
+    if (!roots.empty())
+        this->detect_deadlock(roots);
+}
+
+void ResourceManager::rerun_victims() {
+    for (TaskId id: this->victims) {
+        TaskId rerun = this->tmgr->rerun(id);
+        auto found = this->n_preempted.find(id);
+        if (found == this->n_preempted.end())
+            continue;
+        int n_preempted = found->second;
+        this->n_preempted.erase(found);
+        if (rerun >= 0)
+            this->n_preempted[rerun] = n_preempted;
+    }
+    this->victims.clear();
+}
+
+ResourceVector ResourceManager::reclaim(Task* task) {
+    ResourceVector freed = task->held;
+    this->give(freed);
+    for (int r = 0; r < N_RESOURCES; ++r) {
+        this->holders[r].erase(task);
+    }
+    ResourceVector wanted = {};
+    if (task->waiting != nullptr) {
+        wanted = task->waiting->amounts;
+        this->remove_waiter(task->waiting);
+        task->waiting->killed = true;
+        task->waiting->cv.notify_one();
+    }
+    this->safe_order.erase(
+        std::find(this->safe_order.begin(), this->safe_order.end(), task));
+    this->tasks.erase(task->id);
+    // The waiters that yielded to its request may go now
+    if (!fits(wanted, ResourceVector()))
+        this->wake_waiters(wanted);
+    return freed;
+}
+
+ResourceStats ResourceManager::get_stats() {
+    std::unique_lock<Mutex> lk(this->mutex);
+    return this->stats;
+}
+
+void ResourceManager::task_exited(TaskId id) {
+    if (this->policy == GREEDY)
+        return;
+    std::unique_lock<Mutex> lk(this->mutex);
+    // A killed one keeps its count for the rerun
+    if (this->tmgr != nullptr && !this->tmgr->is_killed(id))
+        this->n_preempted.erase(id);
+    auto found = this->tasks.find(id);
+    if (found == this->tasks.end())
+        return;
+    // Whatever it still holds goes back, and it leaves the order still safe
+    ResourceVector freed = this->reclaim(&found->second);
+    this->wake_waiters(freed);
+    this->recheck_waiters(freed);
+    // Rerun only now: at once, victims would likely deadlock the same way again
+    this->rerun_victims();
+}
+
+void ResourceManager::task_killed(TaskId id) {
+    // Our own victims are reclaimed already, under the lock we still hold
+    if (this->killing.load() == std::this_thread::get_id())
+        return;
+    std::unique_lock<Mutex> lk(this->mutex);
+    this->drop_killed(id);
+}
+
+void ResourceManager::drop_killed(TaskId id) {
+    // Its holdings go back at once, not when it gets to return
+    auto found = this->tasks.find(id);
+    if (found != this->tasks.end()) {
+        ResourceVector freed = this->reclaim(&found->second);
+        this->wake_waiters(freed);
+        this->recheck_waiters(freed);
+        return;
+    }
+    // GREEDY keeps no tasks, only the waiters
+    for (auto& queue: this->waiters) {
+        for (Waiter* w: queue) {
+            if (w->id != id)
+                continue;
+            this->remove_waiter(w);
+            w->killed = true;
+            w->cv.notify_one();
+            return;
+        }
+    }
 }
 
 } // namespace: proj2
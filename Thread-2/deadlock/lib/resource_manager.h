@@ -2,9 +2,18 @@
 #define DEADLOCK_LIB_RESOURCE_MANAGER_H_
 
 #include <map>
+#include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <mutex>
 #include <thread>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <condition_variable>
+#include "lock_profile.h"
 #include "thread_manager.h"
 
 namespace proj2 {
@@ -16,20 +25,173 @@ enum RESOURCE {
     NETWORK
 };
 
+const int N_RESOURCES = NETWORK + 1;
+
+using ResourceVector = std::array<int, N_RESOURCES>;
+
+// The free units of every resource, `kUnitBits` bits each, in one word so
+// that several resources can be taken at once by a single compare-and-swap
+using PackedResources = uint64_t;
+const int kUnitBits = 64 / N_RESOURCES;
+const int kMaxUnits = (1 << kUnitBits) - 1;
+
+enum ResourcePolicy {
+    GREEDY = 0,  // grants whatever is available, may deadlock
+    AVOIDANCE,   // banker's algorithm on the budget claims
+    DETECTION    // grants greedily, kills and reruns a task per deadlock
+};
+
+// How many times one task may be preempted, its reruns included: after
+// that it keeps what it holds, so that it still finishes
+const int kMaxPreemptions = 2;
+
+// Of the requests of one priority class that had to wait
+struct WaitStats {
+    long n_waits;
+    long total_wait;     // usec
+    long max_wait;       // usec
+    // The most times one waiter saw a resource it waits for go to another
+    // task: starvation shows up as a large count
+    long max_overtaken;
+};
+
+struct ResourceStats {
+    long n_deadlocks;
+    long lost_work;  // of the victims, in resource units x msec
+    long n_preemptions;
+    long preempted_work;  // as `lost_work`, of the preempted tasks
+    std::map<int, WaitStats> waits;  // by priority class
+};
+
 class ResourceManager {
 public:
-    ResourceManager(ThreadManager *t, std::map<RESOURCE, int> init_count): \
-        resource_amount(init_count), tmgr(t) {}
-    void budget_claim(std::map<RESOURCE, int> budget);
+    // Throws if a resource has more than `kMaxUnits` units
+    ResourceManager(ThreadManager *t, std::map<RESOURCE, int> init_count,
+                    ResourcePolicy policy = AVOIDANCE);
+    // The most the calling task will hold at once. Under AVOIDANCE a
+    // request is only granted if every claiming task can still finish.
+    // Returns -1, and changes nothing, if the claim is more than there is or
+    // the weight is not positive.
+    //
+    // Except under GREEDY, waiting requests are granted by priority class,
+    // highest first, then by dominant resource fairness: the task holding
+    // the smallest share of any resource, divided by its weight, goes first.
+    // A task that holds nothing yet does not pass a waiter ranked before it
+    // either, so that the large requests of a class do not starve.
+    //
+    // A request that cannot be granted preempts the tasks of lower
+    // priority holding what it lacks: they are killed, lose what they
+    // hold, and are rerun once a task finishes.
+    int budget_claim(std::map<RESOURCE, int> budget, int priority = 0,
+                     double weight = 1);
+    // -1 if the task is killed while it waits, or asks for more than there is
     int request(RESOURCE, int amount);
+    // All the amounts at once or nothing, so a task that takes everything
+    // it needs in one call never holds some while waiting for the rest.
+    // Nothing is taken, and it returns -1, if they add up to more than there is.
+    int request_all(std::map<RESOURCE, int> amounts);
     void release(RESOURCE, int amount);
+    ResourceStats get_stats();
 private:
-    std::map<RESOURCE, int> resource_amount;
-    std::map<RESOURCE, std::mutex> resource_mutex;
-    std::map<RESOURCE, std::condition_variable> resource_cv;
+    struct Waiter;
+    struct Task {
+        Task(TaskId id): id(id), claim(), held(), waiting(nullptr),
+            start(std::chrono::steady_clock::now()), priority(0), weight(1) {}
+        TaskId id;
+        ResourceVector claim;
+        ResourceVector held;
+        Waiter* waiting;
+        std::chrono::steady_clock::time_point start;
+        int priority;
+        double weight;
+    };
+    // A blocked request, granted by the thread that makes it possible and
+    // woken up through its own condition variable only then
+    struct Waiter {
+        Waiter(Task* t, const ResourceVector& a, long seq): id(current_task()),
+            task(t), amounts(a), granted(false), killed(false),
+            priority(t != nullptr? t->priority: 0), seq(seq), overtaken(0),
+            since(std::chrono::steady_clock::now()) {}
+        TaskId id;
+        Task* task;  // none under GREEDY
+        ResourceVector amounts;
+        bool granted;
+        bool killed;  // as the victim of a deadlock, or through the thread manager
+        int priority;
+        long seq;  // the order it came in
+        long overtaken;
+        std::chrono::steady_clock::time_point since;
+        // In the queue of every resource it asks for
+        std::array<std::list<Waiter*>::iterator, N_RESOURCES> places;
+        ConditionVariable cv;
+    };
+
+    // Lock-free, on the packed word
+    bool try_take(const ResourceVector& amounts);
+    void give(const ResourceVector& amounts);
+    ResourceVector get_available() const;
+
+    int acquire(const ResourceVector& amounts);
+    int acquire_greedy(const ResourceVector& amounts);
+    int wait_for_grant(Waiter& waiter, std::unique_lock<Mutex>& lk);
+    Task& task_of(TaskId id);
+    bool try_grant(Task& task, const ResourceVector& amounts);
+    double dominant_share(const Task& task) const;
+    bool ranks_before(const Waiter* waiter, const Task& task) const;
+    bool yields_to_waiter(const Task& task, const ResourceVector& amounts) const;
+    void overtake_waiters(const ResourceVector& amounts, const Waiter* granted);
+    void count_wait(const Waiter& waiter);
+    bool is_safe();
+    bool order_is_safe(const std::vector<Task*>& order);
+    void add_waiter(Waiter* waiter);
+    void remove_waiter(Waiter* waiter);
+    void wake_waiters(const ResourceVector& freed);
+    void detect_deadlock(std::vector<TaskId> roots);
+    void recheck_waiters(const ResourceVector& left);
+    long work_lost(const Task& task, std::chrono::steady_clock::time_point now);
+    void preempt_for(const Task& task, const ResourceVector& amounts);
+    void kill_victim(Task* victim);
+    ResourceVector reclaim(Task* task);
+    void rerun_victims();
+    void task_exited(TaskId id);
+    void task_killed(TaskId id);
+    void drop_killed(TaskId id);
+
+    ResourcePolicy policy;
+    ResourceVector total;
+    std::atomic<PackedResources> free_units;
+    std::atomic<int> n_waiters;  // read by the releases that skip the mutex
+    // Under GREEDY only waiting takes the mutex: requests and releases are
+    // a compare-and-swap on `free_units`, and no task is kept. The other
+    // policies keep the state below, and change `free_units` under it too.
+    // So under AVOIDANCE (the default) and DETECTION every request and
+    // release takes this one mutex: the per-resource locks are gone, but
+    // the hot path is not lock-free. A grant there has to update the task's
+    // holdings, the holders of the wait-for graph and the waiter queues
+    // together with the units, and the safety check reads all of them, so
+    // they share one lock; keeping `safe_order` makes what it guards short.
+    Mutex mutex;
+    std::unordered_map<TaskId, Task> tasks;
+    // An order in which the tasks can all finish, kept from the last check:
+    // releases and new claims never break it, so a request usually only
+    // needs one pass over it instead of a full banker's search
+    std::vector<Task*> safe_order;
+    // Per resource, so that a release only looks at the waiters it may
+    // satisfy; ranked when it does
+    std::array<std::list<Waiter*>, N_RESOURCES> waiters;
+    long n_requests;
+    // The wait-for graph: a waiter waits for the holders of its resources
+    std::array<std::unordered_set<Task*>, N_RESOURCES> holders;
+    // Killed, to rerun once another task finishes and made room
+    std::vector<TaskId> victims;
+    // How many times a task was preempted, passed on to its rerun
+    std::unordered_map<TaskId, int> n_preempted;
+    // Set while we kill a victim ourselves, already reclaimed under the lock
+    std::atomic<std::thread::id> killing;
+    ResourceStats stats;
     ThreadManager *tmgr;
 };
 
 }  // namespce: proj2
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,459 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+#include "thread_manager.h"
+#include "resource_manager.h"
+
+namespace proj2 {
+namespace testing{
+
+std::map<RESOURCE, int> budget(int amount) {
+    return {{GPU, amount}, {MEMORY, amount}, {DISK, amount}, {NETWORK, amount}};
+}
+
+void sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// The two tasks of data/example.in, without the sleeps
+void crossed_task(ResourceManager* mgr, RESOURCE first, RESOURCE second) {
+    mgr->budget_claim({{first, 5}, {second, 6}});
+    ASSERT_EQ(0, mgr->request(first, 5));
+    sleep_ms(50);
+    ASSERT_EQ(0, mgr->request(second, 6));
+    mgr->release(first, 5);
+    mgr->release(second, 6);
+}
+
+TEST(ResourceManagerTest, test_avoids_example_deadlock) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), AVOIDANCE);
+    tmgr.new_task(crossed_task, &mgr, GPU, MEMORY);
+    tmgr.new_task(crossed_task, &mgr, MEMORY, GPU);
+    tmgr.wait();
+}
+
+TEST(ResourceManagerTest, test_unsafe_request_waits) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), AVOIDANCE);
+    std::atomic<bool> a_done(false), b_granted_early(false);
+    tmgr.new_task([&] {
+        mgr.budget_claim({{GPU, 5}, {MEMORY, 6}});
+        mgr.request(GPU, 5);
+        sleep_ms(100);
+        mgr.request(MEMORY, 6);
+        a_done = true;
+        mgr.release(GPU, 5);
+        mgr.release(MEMORY, 6);
+    });
+    sleep_ms(20);
+    tmgr.new_task([&] {
+        mgr.budget_claim({{MEMORY, 5}, {GPU, 6}});
+        // Safe only once `a` is done with its memory
+        mgr.request(MEMORY, 5);
+        b_granted_early = !a_done;
+        mgr.request(GPU, 6);
+        mgr.release(MEMORY, 5);
+        mgr.release(GPU, 6);
+    });
+    tmgr.wait();
+    EXPECT_FALSE(b_granted_early);
+}
+
+TEST(ResourceManagerTest, test_greedy_grants_at_once) {
+    ResourceManager mgr(nullptr, budget(10), GREEDY);
+    std::thread a([&] {
+        mgr.budget_claim({{GPU, 5}, {MEMORY, 6}});
+        EXPECT_EQ(0, mgr.request(GPU, 5));
+    });
+    a.join();
+    std::thread b([&] {
+        mgr.budget_claim({{MEMORY, 5}, {GPU, 6}});
+        EXPECT_EQ(0, mgr.request(MEMORY, 5));
+    });
+    b.join();
+}
+
+TEST(ResourceManagerTest, test_exit_returns_holdings) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(4), AVOIDANCE);
+    tmgr.new_task([&] { mgr.request(DISK, 4); });
+    tmgr.wait();
+    tmgr.new_task([&] {
+        EXPECT_EQ(0, mgr.request(DISK, 4));
+        mgr.release(DISK, 4);
+    });
+    tmgr.wait();
+}
+
+TEST(ResourceManagerTest, test_rejected_claim_changes_nothing) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), AVOIDANCE);
+    tmgr.new_task([&] {
+        EXPECT_EQ(0, mgr.budget_claim({{GPU, 4}}));
+        EXPECT_EQ(-1, mgr.budget_claim({{GPU, 2}, {MEMORY, 11}}, 1));
+        EXPECT_EQ(-1, mgr.budget_claim({{GPU, 2}}, 0, 0));
+        EXPECT_EQ(-1, mgr.request_all({{GPU, 4}, {MEMORY, 11}}));
+        EXPECT_EQ(0, mgr.request(GPU, 4));
+        mgr.release(GPU, 4);
+    });
+    tmgr.wait();
+}
+
+TEST(ResourceManagerTest, test_request_all_or_nothing) {
+    ResourceManager mgr(nullptr, budget(10), GREEDY);
+    EXPECT_EQ(0, mgr.request(MEMORY, 6));
+    std::atomic<bool> granted(false);
+    std::thread t([&] {
+        EXPECT_EQ(0, mgr.request_all({{GPU, 5}, {MEMORY, 6}}));
+        granted = true;
+        mgr.release(GPU, 5);
+        mgr.release(MEMORY, 6);
+    });
+    sleep_ms(50);
+    EXPECT_FALSE(granted);
+    // Nothing was taken while it waits for the memory
+    EXPECT_EQ(0, mgr.request(GPU, 10));
+    mgr.release(GPU, 10);
+    mgr.release(MEMORY, 6);
+    t.join();
+    EXPECT_TRUE(granted);
+    EXPECT_EQ(-1, mgr.request(DISK, 11));
+    // Rejected before anything is taken
+    EXPECT_EQ(-1, mgr.request_all({{GPU, 5}, {DISK, 11}}));
+    EXPECT_EQ(0, mgr.request_all(budget(10)));
+    EXPECT_EQ(1, mgr.request_all({}));
+    EXPECT_EQ(-1, mgr.budget_claim({{DISK, 11}}));
+    EXPECT_THROW(ResourceManager(nullptr, budget(kMaxUnits + 1)), std::runtime_error);
+}
+
+TEST(ResourceManagerTest, test_greedy_counts_stay_exact) {
+    ResourceManager mgr(nullptr, budget(3), GREEDY);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&mgr, i] {
+            RESOURCE r = RESOURCE(i % N_RESOURCES);
+            for (int j = 0; j < 2000; ++j) {
+                if (j % 2 == 0) {
+                    mgr.request(r, 2);
+                    mgr.release(r, 2);
+                } else {
+                    mgr.request_all({{r, 1}, {RESOURCE((r + 1) % N_RESOURCES), 1}});
+                    mgr.release(r, 1);
+                    mgr.release(RESOURCE((r + 1) % N_RESOURCES), 1);
+                }
+            }
+        });
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+    EXPECT_EQ(0, mgr.request_all(budget(3)));
+}
+
+TEST(ResourceManagerTest, test_kill_wakes_waiter) {
+    for (ResourcePolicy policy: {GREEDY, AVOIDANCE}) {
+        ThreadManager tmgr;
+        ResourceManager mgr(&tmgr, budget(4), policy);
+        ASSERT_EQ(0, mgr.request(DISK, 4));
+        std::atomic<int> result(1);
+        TaskId t = tmgr.new_task([&] { result = mgr.request(DISK, 4); });
+        sleep_ms(20);
+        auto begin = std::chrono::steady_clock::now();
+        tmgr.kill(t);
+        tmgr.wait();
+        // Woken up by the kill itself, not after some polling period
+        EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+        EXPECT_EQ(-1, result);
+        mgr.release(DISK, 4);
+        EXPECT_EQ(0, mgr.request(DISK, 4));
+    }
+}
+
+TEST(ResourceManagerTest, test_kill_stops_sleeping_holder) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(4), AVOIDANCE);
+    std::atomic<bool> holding(false), woke_early(false);
+    TaskId t = tmgr.new_task([&] {
+        mgr.budget_claim({{DISK, 4}, {GPU, 1}});
+        mgr.request(DISK, 4);
+        holding = true;
+        woke_early = !current_cancel_token()->sleep_for(std::chrono::seconds(10));
+        // Killed, it gets nothing more
+        EXPECT_EQ(-1, mgr.request(GPU, 1));
+    });
+    while (!holding) {
+        sleep_ms(1);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    tmgr.kill(t);
+    // Reclaimed by the kill itself, whether the task returned yet or not
+    EXPECT_EQ(0, mgr.request(DISK, 4));
+    tmgr.wait();
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+    EXPECT_TRUE(woke_early);
+}
+
+// Returns early when killed, as `workload` does
+void killable_task(ResourceManager* mgr, RESOURCE first, RESOURCE second,
+                   int first_ms, std::atomic<int>* n_done) {
+    mgr->budget_claim({{first, 5}, {second, 6}});
+    if (mgr->request(first, 5) < 0)
+        return;
+    sleep_ms(first_ms);
+    if (mgr->request(second, 6) < 0)
+        return;
+    mgr->release(first, 5);
+    mgr->release(second, 6);
+    ++*n_done;
+}
+
+TEST(ResourceManagerTest, test_detects_and_recovers) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::atomic<int> n_done(0);
+    // `b` is younger when the cycle closes, so it loses less work
+    tmgr.new_task(killable_task, &mgr, GPU, MEMORY, 100, &n_done);
+    sleep_ms(20);
+    tmgr.new_task(killable_task, &mgr, MEMORY, GPU, 30, &n_done);
+    tmgr.wait();
+    EXPECT_EQ(2, n_done);
+    ResourceStats stats = mgr.get_stats();
+    EXPECT_EQ(1, stats.n_deadlocks);
+    // 5 units held by `b` for about 80 msec
+    EXPECT_GE(stats.lost_work, 5 * 70);
+    EXPECT_LT(stats.lost_work, 5 * 100);
+}
+
+TEST(ResourceManagerTest, test_detection_many_tasks) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::atomic<int> n_done(0);
+    for (int i = 0; i < 100; ++i) {
+        RESOURCE first = RESOURCE(i % 4), second = RESOURCE((i + 1 + i / 4 % 3) % 4);
+        tmgr.new_task(killable_task, &mgr, first, second, 1 + i % 3, &n_done);
+    }
+    tmgr.wait();
+    EXPECT_EQ(100, n_done);
+}
+
+TEST(ResourceManagerTest, test_many_tasks_finish) {
+    // Far more tasks than workers, and a waiting task keeps its worker
+    ThreadManager tmgr(8);
+    ResourceManager mgr(&tmgr, budget(8), AVOIDANCE);
+    std::atomic<int> n_done(0);
+    for (int i = 0; i < 200; ++i) {
+        std::mt19937 rng(i);
+        RESOURCE first = RESOURCE(rng() % 4), second = RESOURCE((first + 1 + rng() % 3) % 4);
+        int a1 = 1 + rng() % 8, a2 = 1 + rng() % 8;
+        tmgr.new_task([&mgr, &n_done, first, second, a1, a2] {
+            mgr.budget_claim({{first, a1}, {second, a2}});
+            mgr.request(first, a1);
+            sleep_ms(1);
+            mgr.request(second, a2);
+            mgr.release(first, a1);
+            mgr.release(second, a2);
+            ++n_done;
+        });
+    }
+    tmgr.wait();
+    EXPECT_EQ(200, n_done);
+}
+
+// Holds the GPU until the others wait for it, then frees it 5 units at a time
+void gpu_holder(ResourceManager* mgr, int priority) {
+    mgr->budget_claim({{GPU, 10}}, priority);
+    mgr->request(GPU, 10);
+    sleep_ms(100);
+    mgr->release(GPU, 5);
+    sleep_ms(50);
+    mgr->release(GPU, 5);
+}
+
+// Asks for `amount` GPU while holding `held` memory, and records when it got it
+void gpu_waiter(ResourceManager* mgr, int held, int amount, int priority, int name,
+                std::mutex* mutex, std::vector<int>* order) {
+    mgr->budget_claim({{MEMORY, held}, {GPU, amount}}, priority);
+    if (held > 0)
+        mgr->request(MEMORY, held);
+    ASSERT_EQ(0, mgr->request(GPU, amount));
+    {
+        std::lock_guard<std::mutex> lk(*mutex);
+        order->push_back(name);
+    }
+    sleep_ms(20);
+    mgr->release(GPU, amount);
+    if (held > 0)
+        mgr->release(MEMORY, held);
+}
+
+TEST(ResourceManagerTest, test_smallest_dominant_share_first) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::mutex mutex;
+    std::vector<int> order;
+    tmgr.new_task(gpu_holder, &mgr, 0);
+    sleep_ms(20);
+    // The hog asks first, but holds 8 of the memory against 1
+    tmgr.new_task(gpu_waiter, &mgr, 8, 5, 0, 1, &mutex, &order);
+    sleep_ms(20);
+    tmgr.new_task(gpu_waiter, &mgr, 1, 5, 0, 2, &mutex, &order);
+    tmgr.wait();
+    EXPECT_EQ(std::vector<int>({2, 1}), order);
+    ResourceStats stats = mgr.get_stats();
+    EXPECT_EQ(2, stats.waits[0].n_waits);
+    EXPECT_EQ(1, stats.waits[0].max_overtaken);
+    // About 100 msec, with slack for the sleeps that time it
+    EXPECT_GE(stats.waits[0].max_wait, 80000);
+}
+
+TEST(ResourceManagerTest, test_higher_priority_first) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::mutex mutex;
+    std::vector<int> order;
+    // Not preempted by the waiters
+    tmgr.new_task(gpu_holder, &mgr, 1);
+    sleep_ms(20);
+    tmgr.new_task(gpu_waiter, &mgr, 1, 5, 0, 1, &mutex, &order);
+    sleep_ms(20);
+    tmgr.new_task(gpu_waiter, &mgr, 8, 5, 1, 2, &mutex, &order);
+    tmgr.wait();
+    EXPECT_EQ(std::vector<int>({2, 1}), order);
+    ResourceStats stats = mgr.get_stats();
+    EXPECT_EQ(1, stats.waits[0].n_waits);
+    EXPECT_EQ(1, stats.waits[1].n_waits);
+}
+
+TEST(ResourceManagerTest, test_new_request_does_not_barge) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::mutex mutex;
+    std::vector<int> order;
+    tmgr.new_task(gpu_holder, &mgr, 0);
+    sleep_ms(20);
+    tmgr.new_task(gpu_waiter, &mgr, 0, 8, 0, 1, &mutex, &order);
+    // 5 units are free by then, but the large request came first
+    sleep_ms(120);
+    tmgr.new_task(gpu_waiter, &mgr, 0, 3, 0, 2, &mutex, &order);
+    tmgr.wait();
+    EXPECT_EQ(std::vector<int>({1, 2}), order);
+}
+
+TEST(ResourceManagerTest, test_yielding_waiter_goes_after_grant) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::atomic<bool> released_gpu(false), granted_first(false);
+    tmgr.new_task([&] {
+        mgr.budget_claim({{MEMORY, 10}}, 1);
+        mgr.request(MEMORY, 10);
+        sleep_ms(100);
+        mgr.release(MEMORY, 10);
+    });
+    sleep_ms(20);
+    // Waits for the memory, and is granted the GPU with it
+    tmgr.new_task([&] {
+        mgr.budget_claim({{GPU, 2}, {MEMORY, 5}}, 1);
+        ASSERT_EQ(0, mgr.request_all({{GPU, 2}, {MEMORY, 5}}));
+        sleep_ms(300);
+        released_gpu = true;
+        mgr.release(GPU, 2);
+        mgr.release(MEMORY, 5);
+    });
+    sleep_ms(20);
+    // The GPU is free, but it yields to the task ranked before it, and goes
+    // once that one is granted, not at the next release of the GPU
+    tmgr.new_task([&] {
+        ASSERT_EQ(0, mgr.request(GPU, 2));
+        granted_first = !released_gpu;
+        mgr.release(GPU, 2);
+    });
+    tmgr.wait();
+    EXPECT_TRUE(granted_first);
+}
+
+// Holds the whole GPU for `ms` at priority 0, unless it is preempted
+void batch_task(ResourceManager* mgr, int ms, std::atomic<int>* n_granted,
+                std::atomic<int>* n_done) {
+    mgr->budget_claim({{GPU, 10}});
+    if (mgr->request(GPU, 10) < 0)
+        return;
+    ++*n_granted;
+    if (!current_cancel_token()->sleep_for(std::chrono::milliseconds(ms)))
+        return;
+    // Before the release, which lets the waiting tasks go
+    ++*n_done;
+    mgr->release(GPU, 10);
+}
+
+TEST(ResourceManagerTest, test_preempts_lower_priority) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), AVOIDANCE);
+    std::atomic<int> n_granted(0), n_done(0);
+    std::atomic<bool> batch_done_first(true);
+    tmgr.new_task(batch_task, &mgr, 1000, &n_granted, &n_done);
+    while (n_granted == 0) {
+        sleep_ms(1);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    tmgr.new_task([&] {
+        mgr.budget_claim({{GPU, 5}}, 1);
+        ASSERT_EQ(0, mgr.request(GPU, 5));
+        batch_done_first = n_done > 0;
+        mgr.release(GPU, 5);
+    });
+    tmgr.wait();
+    // Not behind the batch task, which is rerun and finishes after it
+    EXPECT_FALSE(batch_done_first);
+    EXPECT_EQ(2, n_granted);
+    EXPECT_EQ(1, n_done);
+    EXPECT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(1000));
+    ResourceStats stats = mgr.get_stats();
+    EXPECT_EQ(1, stats.n_preemptions);
+    EXPECT_EQ(0, stats.n_deadlocks);
+}
+
+TEST(ResourceManagerTest, test_preemptions_are_capped) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, budget(10), DETECTION);
+    std::atomic<int> n_granted(0), n_done(0);
+    tmgr.new_task(batch_task, &mgr, 200, &n_granted, &n_done);
+    // Each urgent task comes once the batch task holds the GPU again
+    std::vector<bool> preempted;
+    for (int i = 0; i <= kMaxPreemptions; ++i) {
+        while (n_granted <= i) {
+            sleep_ms(1);
+        }
+        std::atomic<bool> done(false), batch_done(false);
+        tmgr.new_task([&] {
+            mgr.budget_claim({{GPU, 10}}, 1);
+            ASSERT_EQ(0, mgr.request(GPU, 10));
+            batch_done = n_done > 0;
+            mgr.release(GPU, 10);
+            done = true;
+        });
+        while (!done) {
+            sleep_ms(1);
+        }
+        preempted.push_back(!batch_done);
+    }
+    tmgr.wait();
+    // The last one waits for the batch task to finish
+    EXPECT_EQ(std::vector<bool>({true, true, false}), preempted);
+    EXPECT_EQ(1, n_done);
+    EXPECT_EQ(kMaxPreemptions, mgr.get_stats().n_preemptions);
+}
+
+} // namespace testing
+} // namespace proj2
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
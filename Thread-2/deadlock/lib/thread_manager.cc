@@ -3,22 +3,201 @@
 
 namespace proj2 {
 
-void ThreadManager::kill(std::thread::id id) {
-    /* NOTE: this function does not really kill the thread. This only
-             marks the thread as dead. See the implementation in
-             `resource_manager.cc` and `workload.cc` for an example
-             of how to return from a killed thread.
+namespace {
+
+// Shared by every manager and by the threads outside of them
+std::atomic<TaskId> last_task_id(0);
+thread_local TaskId this_task = -1;
+thread_local CancelToken* this_token = nullptr;
+thread_local ThreadManager* this_manager = nullptr;
+thread_local int this_checkpoint = 0;
+
+} // namespace
+
+TaskId current_task() {
+    if (this_task < 0)
+        this_task = ++last_task_id;
+    return this_task;
+}
+
+CancelToken* current_cancel_token() {
+    return this_token;
+}
+
+int current_checkpoint() {
+    return this_checkpoint;
+}
+
+void save_checkpoint(int checkpoint) {
+    this_checkpoint = checkpoint;
+    if (this_manager != nullptr)
+        this_manager->set_checkpoint(this_task, checkpoint);
+}
+
+ThreadManager::ThreadManager(int n_workers): n_unfinished(0), stopping(false) {
+    for (int i = 0; i < n_workers; ++i) {
+        this->workers.emplace_back([this] { this->work(); });
+    }
+}
+
+ThreadManager::~ThreadManager() {
+    this->wait();
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->stopping = true;
+    }
+    this->queue_cv.notify_all();
+    for (std::thread& worker: this->workers) {
+        worker.join();
+    }
+}
+
+TaskId ThreadManager::submit(std::function<void()> fn, int checkpoint) {
+    TaskId id = ++last_task_id;
+    {
+        Shard& shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        shard.records.emplace(id, Record(std::move(fn), checkpoint));
+    }
+    {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        ++this->n_unfinished;
+        this->queue.push_back(id);
+    }
+    this->queue_cv.notify_one();
+    return id;
+}
+
+void ThreadManager::work() {
+    while (true) {
+        TaskId id;
+        {
+            std::unique_lock<std::mutex> lk(this->mutex);
+            this->queue_cv.wait(lk, [this] { return this->stopping || !this->queue.empty(); });
+            if (this->queue.empty())
+                return;
+            id = this->queue.front();
+            this->queue.pop_front();
+        }
+        this->run(id);
+    }
+}
+
+void ThreadManager::run(TaskId id) {
+    std::function<void()> fn;
+    std::shared_ptr<CancelToken> token;
+    int checkpoint;
+    {
+        Shard& shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        Record& record = shard.records.at(id);
+        token = record.token;
+        checkpoint = record.checkpoint;
+        record.progress = std::chrono::steady_clock::now();
+        // Killed while it was queued, it does not start at all
+        if (!token->is_cancelled())
+            fn = record.fn;
+    }
+    if (fn) {
+        this_task = id;
+        this_token = token.get();
+        this_manager = this;
+        this_checkpoint = checkpoint;
+        fn();
+        this_task = -1;
+        this_token = nullptr;
+        this_manager = nullptr;
+        this_checkpoint = 0;
+    }
+    this->exited(id);
+}
+
+void ThreadManager::exited(TaskId id) {
+    for (auto& listener: this->exit_listeners) {
+        listener(id);
+    }
+    {
+        Shard& shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        auto found = shard.records.find(id);
+        found->second.exited = true;
+        // A killed one is kept until it is rerun
+        if (!found->second.token->is_cancelled() || !found->second.fn)
+            shard.records.erase(found);
+    }
+    std::lock_guard<std::mutex> lk(this->mutex);
+    if (--this->n_unfinished == 0)
+        this->idle_cv.notify_all();
+}
+
+void ThreadManager::kill(TaskId id) {
+    /* NOTE: this function does not really stop the task. It cancels
+             the task's token, which wakes it up in `a_slow_function` or
+             in a resource request. See `workload.cc` for an example of
+             how to return from a killed task.
     */
-    this->running_status[id] = false;
-    this->running_threads[id]->detach();
+    {
+        Shard& shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        auto found = shard.records.find(id);
+        if (found == shard.records.end() || found->second.token->is_cancelled()
+                || found->second.exited)
+            return;
+        found->second.token->cancel();
+    }
+    for (auto& listener: this->kill_listeners) {
+        listener(id);
+    }
 }
 
-std::thread* ThreadManager::rerun(std::thread::id id) {
-    if (this->running_status[id]) {
-        // The thread is still running, call kill first or handle error here?
+TaskId ThreadManager::rerun(TaskId id) {
+    std::function<void()> fn;
+    int checkpoint;
+    {
+        Shard& shard = this->shard_of(id);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+        auto found = shard.records.find(id);
+        if (found == shard.records.end() || !found->second.token->is_cancelled()
+                || !found->second.fn)
+            return -1;
+        fn.swap(found->second.fn);
+        checkpoint = found->second.checkpoint;
+        if (found->second.exited)
+            shard.records.erase(found);
     }
-    // The parameters are recorded in the lambda functions, just call it
-    return this->new_thread([this, id] {this->functions[id]();});
+    // Resumes at the checkpoint, the closure decides what that means
+    return this->submit(std::move(fn), checkpoint);
+}
+
+bool ThreadManager::is_killed(TaskId id) {
+    Shard& shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto found = shard.records.find(id);
+    return found != shard.records.end() && found->second.token->is_cancelled();
+}
+
+void ThreadManager::set_checkpoint(TaskId id, int checkpoint) {
+    Shard& shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto found = shard.records.find(id);
+    if (found == shard.records.end())
+        return;
+    found->second.checkpoint = checkpoint;
+    found->second.progress = std::chrono::steady_clock::now();
 }
 
-}
\ No newline at end of file
+std::chrono::steady_clock::time_point ThreadManager::progress_since(TaskId id) {
+    Shard& shard = this->shard_of(id);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto found = shard.records.find(id);
+    if (found == shard.records.end())
+        return std::chrono::steady_clock::time_point();
+    return found->second.progress;
+}
+
+void ThreadManager::wait() {
+    std::unique_lock<std::mutex> lk(this->mutex);
+    this->idle_cv.wait(lk, [this] { return this->n_unfinished == 0; });
+}
+
+}
@@ -1,43 +1,142 @@
 #ifndef DEADLOCK_LIB_THREAD_MANAGER_H_
 #define DEADLOCK_LIB_THREAD_MANAGER_H_
 
-#include <map>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
+#include <vector>
 #include <functional>
+#include <unordered_map>
+#include <condition_variable>
 
 namespace proj2 {
 
-// NOTE: ThreadManager is not thread-safe.
-class ThreadManager {
+using TaskId = long;
+
+// The task the calling thread runs for a ThreadManager. Any other thread
+// counts as one task of its own, with an id that no managed task gets.
+TaskId current_task();
+
+// How far the calling task got, as recorded by `save_checkpoint`: a task
+// rerun after a kill starts with the last checkpoint of the killed run, so
+// that it can resume there. 0 if none.
+int current_checkpoint();
+void save_checkpoint(int checkpoint);
+
+// Cancelled once when its task is killed. Waits through it are the
+// cancellation points of a task: they return as soon as it is killed.
+class CancelToken {
 public:
-    ThreadManager() {}
-    void kill(std::thread::id);
-    std::thread* rerun(std::thread::id);
-    template <class Fn, class... Args>
-    std::thread* new_thread(Fn&& fn, Args&&... args);
-    bool is_killed(std::thread::id id) { return !running_status[id]; }
+    CancelToken(): cancelled(false) {}
+    bool is_cancelled() const { return this->cancelled.load(); }
+    void cancel() {
+        std::lock_guard<std::mutex> lk(this->mutex);
+        this->cancelled.store(true);
+        this->cv.notify_all();
+    }
+    // False if cancelled before `duration` is over
+    template <class Rep, class Period>
+    bool sleep_for(const std::chrono::duration<Rep, Period>& duration) {
+        std::unique_lock<std::mutex> lk(this->mutex);
+        return !this->cv.wait_for(lk, duration, [this] { return this->cancelled.load(); });
+    }
 private:
-    std::map<std::thread::id, bool> running_status;
-    std::map<std::thread::id, std::thread*> running_threads;
-    std::map<std::thread::id, std::function<void()> > functions; 
+    std::atomic<bool> cancelled;
+    std::mutex mutex;
+    std::condition_variable cv;
 };
 
-template <class Fn, class... Args>
-std::thread* ThreadManager::new_thread(Fn&& fn, Args&&... args) {
-    std::thread* th = new std::thread(fn, args...);
+// The token of the task the calling thread runs, none outside of a
+// ThreadManager
+CancelToken* current_cancel_token();
+
+// Workloads mostly sleep or wait for resources, so there are more workers
+// than cores; the tasks beyond them queue up instead of getting a thread
+const int kDefaultWorkers = 64;
 
-    // Record this thread
-    this->running_status[th->get_id()] = true;
-    // Record this thread's running arguments for restart
-    this->functions[th->get_id()] = [fn, args...] { (fn)(args...); };
-    // Record this thread's pointer for further detach
-    this->running_threads[th->get_id()] = th;
+// Runs the tasks on a fixed pool of workers, in the order they come.
+// NOTE: every call is thread-safe, so that tasks can kill and rerun each
+// other, e.g. to recover from a deadlock; only `wait` must not be called
+// from a task.
+class ThreadManager {
+public:
+    explicit ThreadManager(int n_workers = kDefaultWorkers);
+    // Waits for the tasks, then stops the workers
+    ~ThreadManager();
+    ThreadManager(const ThreadManager&) = delete;
+    ThreadManager& operator=(const ThreadManager&) = delete;
+    template <class Fn, class... Args>
+    TaskId new_task(Fn&& fn, Args&&... args);
+    // Cancels the task: it stops at its next cancellation point, or at
+    // once if it waits in one
+    void kill(TaskId id);
+    // Submits the function of a killed task again, as a new task. Returns
+    // its id, or -1 when `id` is not a killed task or was rerun already.
+    TaskId rerun(TaskId id);
+    bool is_killed(TaskId id);
+    void set_checkpoint(TaskId id, int checkpoint);
+    // When the task started or last saved a checkpoint: a kill loses the
+    // work since. The epoch of the clock for an unknown task.
+    std::chrono::steady_clock::time_point progress_since(TaskId id);
+    // Waits until every task returned, reruns included
+    void wait();
+    // `listener` is called by every task when its function returns, killed
+    // or not. Add the listeners before starting any task.
+    void on_exit(std::function<void(TaskId)> listener) {
+        this->exit_listeners.push_back(std::move(listener));
+    }
+    // `listener` is called by `kill`, unlocked, when it marks a running or
+    // queued task, e.g. to wake it up where it blocks. Add it before any task.
+    void on_kill(std::function<void(TaskId)> listener) {
+        this->kill_listeners.push_back(std::move(listener));
+    }
+private:
+    struct Record {
+        Record(std::function<void()> fn, int checkpoint): fn(std::move(fn)),
+            token(std::make_shared<CancelToken>()), exited(false),
+            checkpoint(checkpoint), progress() {}
+        std::function<void()> fn;  // kept to rerun it, empty once rerun
+        std::shared_ptr<CancelToken> token;  // and whether it was killed
+        bool exited;
+        int checkpoint;  // passed on to its rerun
+        std::chrono::steady_clock::time_point progress;
+    };
+    // The registry is split by id, so that tasks looking up or killing
+    // different tasks do not contend on one lock
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<TaskId, Record> records;
+    };
+    static const int kShards = 16;
 
-    // HINT: You can record more information of the thread here if needed.
+    Shard& shard_of(TaskId id) { return this->shards[id % kShards]; }
+    TaskId submit(std::function<void()> fn, int checkpoint = 0);
+    void work();
+    void run(TaskId id);
+    void exited(TaskId id);
 
-    return th;
+    std::array<Shard, kShards> shards;
+    std::mutex mutex;  // of the queue and the count
+    std::condition_variable queue_cv;
+    std::condition_variable idle_cv;
+    std::deque<TaskId> queue;
+    int n_unfinished;  // queued or running
+    bool stopping;
+    std::vector<std::thread> workers;
+    std::vector<std::function<void(TaskId)> > exit_listeners;
+    std::vector<std::function<void(TaskId)> > kill_listeners;
+};
+
+template <class Fn, class... Args>
+TaskId ThreadManager::new_task(Fn&& fn, Args&&... args) {
+    // The arguments are recorded in the function, to rerun it as it was
+    return this->submit([fn, args...] { (fn)(args...); });
 }
 
 }  // namespce: proj2
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "thread_manager.h"
+
+namespace proj2 {
+namespace testing{
+
+TEST(ThreadManagerTest, test_runs_tasks_on_workers) {
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::set<TaskId> ids;
+    std::atomic<int> n_done(0);
+    {
+        ThreadManager tmgr(4);
+        for (int i = 0; i < 10000; ++i) {
+            tmgr.new_task([&] {
+                std::lock_guard<std::mutex> lk(mutex);
+                threads.insert(std::this_thread::get_id());
+                ids.insert(current_task());
+                ++n_done;
+            });
+        }
+        tmgr.wait();
+        EXPECT_EQ(10000, n_done);
+        // Submitted from a task, and waited for all the same
+        tmgr.new_task([&] { tmgr.new_task([&] { ++n_done; }); });
+    }
+    EXPECT_EQ(10001, n_done);
+    EXPECT_LE(threads.size(), 4u);
+    EXPECT_EQ(10000u, ids.size());
+    EXPECT_EQ(0u, ids.count(current_task()));
+}
+
+TEST(ThreadManagerTest, test_kill_and_rerun) {
+    ThreadManager tmgr(2);
+    std::atomic<int> n_runs(0), n_exits(0), n_killed(0);
+    tmgr.on_exit([&] (TaskId) { ++n_exits; });
+    tmgr.on_kill([&] (TaskId) { ++n_killed; });
+    std::atomic<bool> release(false);
+    TaskId id = tmgr.new_task([&] {
+        ++n_runs;
+        while (!release && !tmgr.is_killed(current_task())) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    EXPECT_EQ(-1, tmgr.rerun(id));  // not killed
+    while (n_runs == 0) {
+        std::this_thread::yield();
+    }
+    tmgr.kill(id);
+    tmgr.kill(id);
+    EXPECT_TRUE(tmgr.is_killed(id));
+    tmgr.wait();
+    EXPECT_EQ(1, n_killed);
+    release = true;
+    TaskId again = tmgr.rerun(id);
+    EXPECT_NE(-1, again);
+    EXPECT_NE(id, again);
+    EXPECT_EQ(-1, tmgr.rerun(id));  // once only
+    tmgr.wait();
+    EXPECT_EQ(2, n_runs);
+    EXPECT_EQ(2, n_exits);
+    EXPECT_FALSE(tmgr.is_killed(again));
+}
+
+TEST(ThreadManagerTest, test_kill_cancels_sleep) {
+    ThreadManager tmgr(2);
+    EXPECT_EQ(nullptr, current_cancel_token());
+    std::atomic<bool> sleeping(false), slept(false), cancelled(false);
+    tmgr.new_task([&] {
+        slept = current_cancel_token()->sleep_for(std::chrono::milliseconds(1));
+    });
+    TaskId id = tmgr.new_task([&] {
+        sleeping = true;
+        cancelled = !current_cancel_token()->sleep_for(std::chrono::seconds(10));
+    });
+    while (!sleeping) {
+        std::this_thread::yield();
+    }
+    auto begin = std::chrono::steady_clock::now();
+    tmgr.kill(id);
+    tmgr.wait();
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+    EXPECT_TRUE(slept);
+    EXPECT_TRUE(cancelled);
+}
+
+TEST(ThreadManagerTest, test_rerun_resumes_at_checkpoint) {
+    ThreadManager tmgr(2);
+    std::atomic<int> n_first(0), n_second(0);
+    std::atomic<bool> saved(false);
+    TaskId id = tmgr.new_task([&] {
+        if (current_checkpoint() < 1) {
+            ++n_first;
+            save_checkpoint(1);
+            saved = true;
+            // Killed here
+            if (!current_cancel_token()->sleep_for(std::chrono::seconds(10)))
+                return;
+        }
+        ++n_second;
+    });
+    while (!saved) {
+        std::this_thread::yield();
+    }
+    auto before = std::chrono::steady_clock::now();
+    EXPECT_LE(tmgr.progress_since(id), before);
+    tmgr.kill(id);
+    tmgr.wait();
+    tmgr.rerun(id);
+    tmgr.wait();
+    EXPECT_EQ(1, n_first);
+    EXPECT_EQ(1, n_second);
+    EXPECT_EQ(0, current_checkpoint());
+}
+
+TEST(ThreadManagerTest, test_killed_in_queue_never_starts) {
+    ThreadManager tmgr(1);
+    std::atomic<bool> release(false);
+    std::atomic<int> n_runs(0);
+    tmgr.new_task([&] {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    TaskId queued = tmgr.new_task([&] { ++n_runs; });
+    tmgr.kill(queued);
+    release = true;
+    tmgr.wait();
+    EXPECT_EQ(0, n_runs);
+    tmgr.rerun(queued);
+    tmgr.wait();
+    EXPECT_EQ(1, n_runs);
+}
+
+TEST(ThreadManagerTest, test_tasks_kill_and_rerun_each_other) {
+    ThreadManager tmgr(16);
+    std::atomic<int> n_runs(0);
+    std::vector<TaskId> ids;
+    std::atomic<bool> ready(false);
+    for (int i = 0; i < 8; ++i) {
+        tmgr.new_task([&, i] {
+            while (!ready) {
+                std::this_thread::yield();
+            }
+            for (int j = i; j < 200; j += 8) {
+                tmgr.kill(ids[j]);
+                tmgr.rerun(ids[j]);
+            }
+        });
+    }
+    for (int i = 0; i < 200; ++i) {
+        ids.push_back(tmgr.new_task([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ++n_runs;
+        }));
+    }
+    ready = true;
+    tmgr.wait();
+    // Once if it finished before its kill, or was killed in the queue; twice
+    // if it was killed while it ran
+    EXPECT_GE(n_runs, 200);
+    EXPECT_LE(n_runs, 400);
+}
+
+} // namespace testing
+} // namespace proj2
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
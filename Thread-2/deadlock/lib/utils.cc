@@ -7,11 +7,17 @@
 #include <sstream>
 #include <iostream>
 #include "utils.h"
+#include "thread_manager.h"
 
 namespace proj2 {
 
-void a_slow_function(int seconds) {
-    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+bool a_slow_function(int seconds) {
+    CancelToken* token = current_cancel_token();
+    if (token == nullptr) {
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        return true;
+    }
+    return token->sleep_for(std::chrono::seconds(seconds));
 }
 
 int randint(int lower, int upper) {
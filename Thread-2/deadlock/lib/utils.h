@@ -8,7 +8,8 @@
 
 namespace proj2 {
 
-void a_slow_function(int seconds);
+// A cancellation point: returns false at once if the calling task is killed
+bool a_slow_function(int seconds);
 
 int randint(int lower, int upper);  // sample int from [lower, upper]
 
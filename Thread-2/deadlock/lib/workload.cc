@@ -1,22 +1,38 @@
 #include <map>
+#include <sstream>
+#include <iostream>
 #include <thread>
 #include <utility>
 #include "workload.h"
 #include "resource_manager.h"
 #include "utils.h"
+#include "thread_manager.h"
 
 namespace proj2 {
 
+std::map<RESOURCE, int> workload_budget(RESOURCE rsc1, RESOURCE rsc2,
+                                        int rsc1_amount, int rsc2_amount) {
+    std::map<RESOURCE, int> budget;
+    budget[rsc1] += rsc1_amount;
+    budget[rsc2] += rsc2_amount;
+    return budget;
+}
+
 void workload(ResourceManager *mgr,
               RESOURCE rsc1, RESOURCE rsc2,
               int rsc1_amount, int rsc2_amount,
               int sleep_time1, int sleep_time2,
-              int reverse_order) {
+              int reverse_order, int priority, double weight) {
     // Inform the resource manager about resource budget
-    std::map<RESOURCE, int> budget = {
-        {rsc1, rsc1_amount}, {rsc2, rsc2_amount}
-    };
-    mgr->budget_claim(budget);
+    std::map<RESOURCE, int> budget = workload_budget(rsc1, rsc2, rsc1_amount, rsc2_amount);
+    if (mgr->budget_claim(budget, priority, weight) < 0) {
+        std::ostringstream msg;
+        msg << "Skipped a task claiming " << rsc1_amount << " of resource " << rsc1
+            << " and " << rsc2_amount << " of resource " << rsc2
+            << ", more than there is\n";
+        std::cerr << msg.str();
+        return;
+    }
     // Randomness
     if (reverse_order < 0) {
         reverse_order = randbit();
@@ -29,12 +45,24 @@ void workload(ResourceManager *mgr,
     sleep_time2 = sleep_time2 < 0? randint(MIN_RUNNING_TIME, MAX_RUNNING_TIME): sleep_time2;
 
     // Request resource -> running -> request another -> running -> release
-    if (mgr->request(rsc1, rsc1_amount) < 0)  // I'm killed
-        return;
-    a_slow_function(sleep_time1);
-    if (mgr->request(rsc2, rsc2_amount) < 0) // I'm killed
+    // Once killed, what it holds is reclaimed already
+    if (current_checkpoint() < FIRST_PART_DONE) {
+        if (mgr->request(rsc1, rsc1_amount) < 0)  // I'm killed
+            return;
+        if (!a_slow_function(sleep_time1))
+            return;
+        save_checkpoint(FIRST_PART_DONE);
+        if (mgr->request(rsc2, rsc2_amount) < 0) // I'm killed
+            return;
+    } else {
+        // Rerun after a kill that took back rsc1: the first part is not
+        // redone, and both are taken at once, so that it cannot be caught
+        // holding one of them again
+        if (mgr->request_all(budget) < 0)  // I'm killed
+            return;
+    }
+    if (!a_slow_function(sleep_time2))
         return;
-    a_slow_function(sleep_time2);
     mgr->release(rsc1, rsc1_amount);
     mgr->release(rsc2, rsc2_amount);
 }
@@ -1,6 +1,7 @@
 #ifndef DEADLOCK_LIB_WORKLOAD_H_
 #define DEADLOCK_LIB_WORKLOAD_H_
 
+#include <map>
 #include <thread>
 #include "resource_manager.h"
 
@@ -9,6 +10,16 @@ namespace proj2 {
 const int MIN_RUNNING_TIME = 3;
 const int MAX_RUNNING_TIME = 10;
 
+// The checkpoint a workload saves once it ran with its first resource, so
+// that a rerun resumes with the second part
+const int FIRST_PART_DONE = 1;
+
+// What a task of `workload` claims, and takes at once when it is rerun: the
+// two amounts, summed if they are of the same resource
+std::map<RESOURCE, int> workload_budget(RESOURCE rsc1, RESOURCE rsc2,
+                                        int rsc1_amount, int rsc2_amount);
+
+// Skips the task, and says so on stderr, if it claims more than there is
 void workload(
     ResourceManager *mgr,
     RESOURCE rsc1,
@@ -17,7 +28,9 @@ void workload(
     int rsc2_amount,
     int sleep_time1 = -1,  // -1 for random
     int sleep_time2 = -1,   // -1 for random
-    int reverse_order = -1  // -1 for random, 1 for true, 0 for false
+    int reverse_order = -1,  // -1 for random, 1 for true, 0 for false
+    int priority = 0,  // the class it waits in, higher goes first
+    double weight = 1  // its fair share within the class
 );  // workload will call mgr->budget_claim when started
 
 }  // namespce: proj2
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <chrono>
+#include "thread_manager.h"
+#include "resource_manager.h"
+#include "workload.h"
+
+namespace proj2 {
+namespace testing{
+
+// The deadlock of data/example.in, with 1 second for the first parts
+TEST(WorkloadTest, test_victim_resumes_after_first_part) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, {{GPU, 10}, {MEMORY, 10}, {DISK, 10}, {NETWORK, 10}},
+                        DETECTION);
+    auto begin = std::chrono::steady_clock::now();
+    tmgr.new_task(workload, &mgr, GPU, MEMORY, 5, 6, 1, 0, 0, 0, 1.0);
+    tmgr.new_task(workload, &mgr, MEMORY, GPU, 5, 6, 1, 0, 0, 0, 1.0);
+    tmgr.wait();
+    EXPECT_EQ(1, mgr.get_stats().n_deadlocks);
+    // Restarted from the beginning, the victim would sleep another second
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(1500));
+    // Both are done and released everything
+    EXPECT_EQ(0, mgr.request_all({{GPU, 10}, {MEMORY, 10}}));
+}
+
+TEST(WorkloadTest, test_budget_sums_one_resource) {
+    std::map<RESOURCE, int> budget = workload_budget(GPU, GPU, 4, 5);
+    ASSERT_EQ(1u, budget.size());
+    EXPECT_EQ(9, budget[GPU]);
+    budget = workload_budget(GPU, DISK, 4, 5);
+    EXPECT_EQ(4, budget[GPU]);
+    EXPECT_EQ(5, budget[DISK]);
+}
+
+TEST(WorkloadTest, test_task_over_budget_is_skipped) {
+    ThreadManager tmgr;
+    ResourceManager mgr(&tmgr, {{GPU, 10}, {MEMORY, 10}, {DISK, 10}, {NETWORK, 10}},
+                        AVOIDANCE);
+    tmgr.new_task(workload, &mgr, GPU, MEMORY, 11, 2, 0, 0, 0, 0, 1.0);
+    tmgr.new_task(workload, &mgr, GPU, MEMORY, 5, 6, 0, 0, 0, 0, 1.0);
+    tmgr.wait();
+    EXPECT_EQ(0, mgr.request_all({{GPU, 10}, {MEMORY, 10}}));
+}
+
+} // namespace testing
+} // namespace proj2
+
+int main(int argc,char **argv){
+  testing::InitGoogleTest(&argc,argv);
+  return RUN_ALL_TESTS();
+}
@@ -3,10 +3,12 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <iostream>
 #include "lib/utils.h"
 #include "lib/workload.h"
 #include "lib/thread_manager.h"
 #include "lib/resource_manager.h"
+#include "lib/admission.h"
 
 namespace proj2 {
 
@@ -47,7 +49,9 @@ void run_instruction(ResourceManager *mgr, Instruction inst) {
     int st1 = inst.size() > 4? inst[4]: -1;
     int st2 = inst.size() > 5? inst[5]: -1;
     int ro = inst.size() > 6? inst[6]: -1;
-    workload(mgr, rsc1, rsc2, inst[2], inst[3], st1, st2, ro);
+    int priority = inst.size() > 7? inst[7]: 0;
+    int weight = inst.size() > 8? inst[8]: 1;
+    workload(mgr, rsc1, rsc2, inst[2], inst[3], st1, st2, ro, priority, weight);
 }
 
 }
@@ -58,23 +62,61 @@ int main(int argc, char *argv[]) {
     std::ifstream ifs(datafile);
     if (!ifs.is_open())
         return 1;
+    // Optionally the policy, "greedy", "avoidance" (the default) or "detection"
+    proj2::ResourcePolicy policy = proj2::AVOIDANCE;
+    if (argc > 2 && std::string(argv[2]) == "greedy")
+        policy = proj2::GREEDY;
+    if (argc > 2 && std::string(argv[2]) == "detection")
+        policy = proj2::DETECTION;
+    // And how tasks are launched, "packed" (the default) by the admission
+    // scheduler or "all" at once
+    bool packed = !(argc > 3 && std::string(argv[3]) == "all");
     proj2::ThreadManager *tmgr = new proj2::ThreadManager();
-    proj2::ResourceManager *rmgr = \
-        new proj2::ResourceManager(tmgr, proj2::read_resource_budget(ifs));
+    std::map<proj2::RESOURCE, int> budget = proj2::read_resource_budget(ifs);
+    proj2::ResourceManager *rmgr = new proj2::ResourceManager(tmgr, budget, policy);
+    proj2::AdmissionScheduler *scheduler = new proj2::AdmissionScheduler(tmgr, budget);
     std::vector<proj2::Instruction> instructions = proj2::read_instruction(ifs);
     ifs.close();
     proj2::AutoTimer timer("deadlock");
 
-    // Run the instructions in parallel without deadlocks
-    std::vector<std::thread*> pool;
-    for (auto inst: instructions) {
-        pool.push_back(tmgr->new_thread(&proj2::run_instruction, rmgr, inst));
+    // Run the instructions in parallel without deadlocks: all at once, as
+    // many as there are workers, or as many as their claims fit
+    for (auto& inst: instructions) {
+        if (inst.size() < 4)
+            continue;
+        if (packed) {
+            std::map<proj2::RESOURCE, int> claim = proj2::workload_budget(
+                static_cast<proj2::RESOURCE>(inst[0]), static_cast<proj2::RESOURCE>(inst[1]),
+                inst[2], inst[3]);
+            if (!scheduler->submit(claim, &proj2::run_instruction, rmgr, inst)) {
+                std::cerr << "Skipped a task claiming " << inst[2] << " of resource "
+                          << inst[0] << " and " << inst[3] << " of resource " << inst[1]
+                          << ", more than there is\n";
+            }
+        } else {
+            tmgr->new_task(&proj2::run_instruction, rmgr, inst);
+        }
     }
+    scheduler->start();
 
-    for (auto t: pool) {
-        auto id = t->get_id();
-        if (tmgr->is_killed(id)) continue;
-        t->join();
+    // Reruns included
+    tmgr->wait();
+    proj2::ResourceStats stats = rmgr->get_stats();
+    if (stats.n_deadlocks > 0) {
+        std::cout << "recovered from " << stats.n_deadlocks << " deadlocks, "
+                  << stats.lost_work << " unit msec lost\n";
+    }
+    if (stats.n_preemptions > 0) {
+        std::cout << "preempted " << stats.n_preemptions << " tasks, "
+                  << stats.preempted_work << " unit msec lost\n";
+    }
+    // Highest priority first
+    for (auto it = stats.waits.rbegin(); it != stats.waits.rend(); ++it) {
+        const proj2::WaitStats& waits = it->second;
+        std::cout << "priority " << it->first << ": " << waits.n_waits << " waits, "
+                  << waits.total_wait / 1000 / waits.n_waits << " msec on average, "
+                  << waits.max_wait / 1000 << " msec at most, overtaken "
+                  << waits.max_overtaken << " times at most\n";
     }
 
     return 0;